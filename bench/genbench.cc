@@ -0,0 +1,163 @@
+// Benchmarks the generator by running superfuzz on fixed inputs and reports
+// the results as CSV.
+//
+// --bench=classes scales --num-classes and reports how long generating a
+// program takes and how much memory it needs.  Every class rolls for bases
+// among all the classes before it, so this is dominated by tracking the base
+// closure of each class.  Classes are streamed, so that only that closure,
+// and not every field and method, is kept.
+//
+// --bench=emission generates one large program without bases, so that most
+// of the time goes into writing it out, and reports how fast the program
+// text is emitted, taken from the generator's --stats.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "option.h"
+#include "process.h"
+
+static Option<std::string> bench("bench", "classes");
+// Comma-separated class counts for --bench=classes.
+static Option<std::string> class_counts("class-counts", "1000,10000,100000");
+// The size of the program for --bench=emission.
+static Option<int> emission_classes("emission-classes", 5000);
+// Generate the program for --bench=emission this many times and keep the
+// fastest.
+static Option<int> repeat("repeat", 3);
+static Option<unsigned long> seed("seed", 1);
+// Defaults to the superfuzz next to this executable.
+static Option<std::string> generator("generator");
+static Option<bool> show_help("help", false);
+
+static bool parse_counts(const std::string &list, std::vector<int> &counts) {
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    char *end;
+    long count = strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end || count <= 0)
+      return false;
+    counts.push_back(count);
+  }
+  return !counts.empty();
+}
+
+static int bench_classes(const char *program_name,
+                         const std::string &generator_path) {
+  std::vector<int> counts;
+  if (!parse_counts(class_counts, counts)) {
+    std::cerr << program_name
+              << ": --class-counts must be a list of positive numbers\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "classes,seconds,peak_rss_kb,classes_per_second\n"
+            << std::fixed;
+  for (int count : counts) {
+    CommandUsage usage;
+    std::string command =
+        shell_quote(generator_path) + " --seed=" + std::to_string(seed) +
+        " --num-classes=" + std::to_string(count) +
+        " --chance-of-base=1 --fast-base-selection --max-num-fields=3"
+        " --stream > /dev/null";
+    if (!measure_command(command, usage) || usage.status != 0) {
+      std::cerr << program_name << ": " << command << " failed\n";
+      return EXIT_FAILURE;
+    }
+    std::cout << count << ',' << std::setprecision(3) << usage.wall_seconds
+              << ',' << usage.peak_rss_kb << ',' << std::setprecision(0)
+              << count / usage.wall_seconds << '\n';
+  }
+  return EXIT_SUCCESS;
+}
+
+// Finds the number after "`key`": in the JSON text `json`.
+static bool json_number(const std::string &json, const std::string &key,
+                        double &value) {
+  std::string quoted = '"' + key + "\":";
+  size_t pos = json.find(quoted);
+  if (pos == std::string::npos)
+    return false;
+  value = strtod(json.c_str() + pos + quoted.size(), nullptr);
+  return true;
+}
+
+static int bench_emission(const char *program_name,
+                          const std::string &generator_path) {
+  char stats_path[] = "/tmp/genbench-stats-XXXXXX";
+  int fd = mkstemp(stats_path);
+  if (fd == -1) {
+    std::cerr << program_name << ": could not create a stats file\n";
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  std::string command =
+      shell_quote(generator_path) + " --seed=" + std::to_string(seed) +
+      " --num-classes=" + std::to_string(emission_classes) +
+      " --chance-of-base=0 --fast-base-selection --max-num-fields=60"
+      " --stats=" + shell_quote(stats_path) + " > /dev/null";
+  double bytes = 0, best_emission = 0, best_wall = 0;
+  for (int run = 0; run < std::max(1, int(repeat)); ++run) {
+    CommandUsage usage;
+    std::ifstream in;
+    std::string json;
+    double emission;
+    if (measure_command(command, usage) && usage.status == 0) {
+      in.open(stats_path);
+      json.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+    }
+    if (!json_number(json, "bytes_emitted", bytes) ||
+        !json_number(json, "emission", emission)) {
+      std::cerr << program_name << ": " << command << " failed\n";
+      std::remove(stats_path);
+      return EXIT_FAILURE;
+    }
+    if (run == 0 || emission < best_emission)
+      best_emission = emission;
+    if (run == 0 || usage.wall_seconds < best_wall)
+      best_wall = usage.wall_seconds;
+  }
+  std::remove(stats_path);
+
+  double megabytes = bytes / 1e6;
+  std::cout << "classes,bytes,emission_seconds,emission_mb_per_second,"
+               "wall_seconds,wall_mb_per_second\n"
+            << std::fixed << emission_classes << ','
+            << std::setprecision(0) << bytes << ',' << std::setprecision(3)
+            << best_emission << ',' << std::setprecision(1)
+            << megabytes / best_emission << ',' << std::setprecision(3)
+            << best_wall << ',' << std::setprecision(1)
+            << megabytes / best_wall << '\n';
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, const char *argv[]) {
+  parse_options(argc, argv);
+
+  if (show_help) {
+    usage(argv[0]);
+    return EXIT_SUCCESS;
+  }
+
+  std::string generator_path = generator;
+  if (generator_path.empty())
+    generator_path = sibling_program(argv[0], "superfuzz");
+
+  if (std::string(bench) == "classes")
+    return bench_classes(argv[0], generator_path);
+  if (std::string(bench) == "emission")
+    return bench_emission(argv[0], generator_path);
+  std::cerr << argv[0] << ": unknown --bench " << std::string(bench) << '\n';
+  return EXIT_FAILURE;
+}
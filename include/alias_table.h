@@ -0,0 +1,37 @@
+#ifndef SUPERFUZZ_ALIAS_TABLE_H
+#define SUPERFUZZ_ALIAS_TABLE_H
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Draws indices in proportion to integer weights in constant time, with
+// Vose's alias method.  Each index owns a column of equal height split
+// between itself and one alias; a draw picks a column uniformly, then a
+// height within it.  Columns an index fills alone need no second number, so
+// with equal weights a draw takes exactly the one number a uniform
+// distribution over the indices would.
+class AliasTable {
+ public:
+  // `weights` must not be negative and must not all be zero.
+  explicit AliasTable(const std::vector<int> &weights);
+
+  template <typename Random>
+  int operator()(Random &random) {
+    int column = column_dist(random);
+    if (thresholds[column] == total_weight)
+      return column;
+    return height_dist(random) < thresholds[column] ? column : aliases[column];
+  }
+
+ private:
+  // A column of index i holds i below thresholds[i] and aliases[i] above,
+  // out of total_weight.
+  std::vector<uint64_t> thresholds;
+  std::vector<int> aliases;
+  uint64_t total_weight;
+  std::uniform_int_distribution<int> column_dist;
+  std::uniform_int_distribution<uint64_t> height_dist;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef SUPERFUZZ_ARENA_H
+#define SUPERFUZZ_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// A bump allocator for everything that describes one generated program.
+// Memory is handed out from large blocks and only released all at once by
+// reset(), which keeps the blocks so that the next program reuses them.
+// Objects placed in an arena are never destroyed, so anything they own must
+// live in the same arena.
+class Arena {
+ public:
+  Arena() : current_block(0), ptr(nullptr), end(nullptr) {}
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(size_t size, size_t alignment) {
+    uintptr_t aligned = (uintptr_t(ptr) + alignment - 1) & ~(alignment - 1);
+    if (!ptr || aligned + size > uintptr_t(end))
+      return allocate_slow(size, alignment);
+    ptr = reinterpret_cast<char *>(aligned + size);
+    return reinterpret_cast<void *>(aligned);
+  }
+
+  template <typename T, typename... Args>
+  T *create(Args &&... args) {
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Forgets every allocation in constant time.
+  void reset();
+
+  // Bytes held in blocks, used or not.
+  size_t bytes_reserved() const;
+
+ private:
+  struct Block {
+    std::unique_ptr<char[]> memory;
+    size_t size;
+  };
+
+  void *allocate_slow(size_t size, size_t alignment);
+
+  std::vector<Block> blocks;
+  size_t current_block;
+  char *ptr;
+  char *end;
+};
+
+// Lets standard containers allocate from an Arena.  Deallocation is a no-op;
+// the memory comes back when the arena is reset.
+template <typename T>
+struct ArenaAllocator {
+  typedef T value_type;
+
+  Arena *arena;
+
+  ArenaAllocator(Arena &arena) : arena(&arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *, size_t) {}
+};
+
+template <typename T, typename U>
+inline bool operator==(const ArenaAllocator<T> &lhs,
+                       const ArenaAllocator<U> &rhs) {
+  return lhs.arena == rhs.arena;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T> &lhs,
+                       const ArenaAllocator<U> &rhs) {
+  return lhs.arena != rhs.arena;
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef SUPERFUZZ_CAPTURED_LAYOUT_H
+#define SUPERFUZZ_CAPTURED_LAYOUT_H
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// What a line of a generated program's output reports.
+enum LayoutLineKind {
+  LayoutLine_FieldOffset,
+  LayoutLine_Size,
+  LayoutLine_Alignment,
+};
+
+// One line of a generated program's output that reports layout.  `name`
+// points into the line: a field for an offset, a class otherwise.
+struct LayoutLine {
+  LayoutLineKind kind;
+  const char *name;
+  size_t name_length;
+  unsigned long long value;
+};
+
+// What a generated program prints, and the status it exits with, when it
+// cannot allocate the memory to construct the next class it tests in.  The
+// tests before it are complete; that class and the rest were not tested.
+static const char kOutOfMemoryLine[] = "OUT OF MEMORY";
+static const int kOutOfMemoryStatus = 77;
+
+// Parses the line [begin, end), without its newline, as printed in either
+// dialect: "<field> : <offset>", "sizeof(<class>): <size>", or
+// "__alignof__(<class>): <alignment>" or "__alignof(...)", each after any
+// indentation.  Returns false for any other line.
+bool parse_layout_line(const char *begin, const char *end, LayoutLine &line);
+
+// The layout of one class as a reference compiler's build of a generated
+// program printed it.
+struct CapturedLayout {
+  unsigned long long size;
+  unsigned long long alignment;
+  bool has_size;
+  bool has_alignment;
+  // The class's own fields, printed by its constructor, and their offsets.
+  std::vector<std::pair<std::string, unsigned long long>> field_offsets;
+
+  CapturedLayout() : size(0), alignment(0), has_size(false),
+                     has_alignment(false) {}
+};
+
+// Captured layouts by class name.
+typedef std::unordered_map<std::string, CapturedLayout> CapturedLayouts;
+
+// Reads what a generated program printed when run, in either dialect.  A
+// test prints the fields of every subobject it constructs, the tested
+// class's own last, then its sizeof and alignment; the trailing fields
+// named after the class are taken as its own.  Lines that are not layout
+// lines are ignored.
+bool read_captured_layouts(const std::string &path, CapturedLayouts &layouts,
+                           std::string &error);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef SUPERFUZZ_CONTEXT_H
+#define SUPERFUZZ_CONTEXT_H
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "arena.h"
+
+typedef std::mt19937 generator_type;
+
+struct BaseClosure;
+struct Class;
+struct GenerationStats;
+class LayoutEngine;
+
+// All of the state mutated while generating a single program.  Every job owns
+// its own context, so programs for different seeds can be generated
+// concurrently and each one only depends on its seed.  A context can be
+// reset and reused for the next program without returning memory to the
+// heap.
+struct GenerationContext {
+  generator_type generator;
+  // The seed `generator` started from.
+  unsigned long seed;
+  // Holds the classes and everything they own.
+  Arena arena;
+  // Holds the class being generated when classes are streamed; only its
+  // base closure is kept in `arena` once it has been written.
+  Arena scratch_arena;
+  // Null for the classes already written when classes are streamed.
+  std::vector<Class *> types;
+  // The base closure of each class, which later classes are built from.
+  std::vector<const BaseClosure *> base_closures;
+  // The canonical layout hash of each class, filled in as classes are
+  // generated when layouts are deduplicated.
+  std::vector<uint64_t> layout_hashes;
+  // When set, the emitted program checks itself against these layouts.
+  const LayoutEngine *expected_layouts;
+  // When set, generation counts what it does here.  Kept across resets.
+  GenerationStats *stats;
+
+  explicit GenerationContext(unsigned long seed)
+      : generator(seed), seed(seed), expected_layouts(nullptr),
+        stats(nullptr) {}
+
+  void reset(unsigned long seed) {
+    generator.seed(seed);
+    this->seed = seed;
+    arena.reset();
+    scratch_arena.reset();
+    types.clear();
+    base_closures.clear();
+    layout_hashes.clear();
+    expected_layouts = nullptr;
+  }
+
+  GenerationContext(const GenerationContext &) = delete;
+  GenerationContext &operator=(const GenerationContext &) = delete;
+};
+
+// Pairs a model object with the context its class indices refer to so that it
+// can be streamed: `stream << in_context(context, type)`.
+template <typename T>
+struct InContext {
+  const GenerationContext &context;
+  const T &value;
+};
+
+template <typename T>
+inline InContext<T> in_context(const GenerationContext &context,
+                               const T &value) {
+  return InContext<T>{context, value};
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef SUPERFUZZ_COVERAGE_H
+#define SUPERFUZZ_COVERAGE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "random_stream.h"
+#include "type.h"
+
+// Properties of a class that change how it is laid out.
+enum LayoutFeature {
+  LayoutFeature_NonvirtualBase,
+  LayoutFeature_VirtualBase,
+  LayoutFeature_MultipleBases,
+  LayoutFeature_Packed,
+  LayoutFeature_Aligned,
+  LayoutFeature_Vtordisp,
+  LayoutFeature_Bitfield,
+  LayoutFeature_AnonymousBitfield,
+  LayoutFeature_AlignedBitfield,
+  LayoutFeature_Array,
+  LayoutFeature_AlignedField,
+  LayoutFeature_ClassField,
+  LayoutFeature_PMFField,
+  LayoutFeature_PDMField,
+  LayoutFeature_VirtualMethod,
+  LayoutFeature_PureMethod,
+  LayoutFeature_Count,
+};
+
+// A set of LayoutFeatures, one bit each.
+typedef uint32_t LayoutFeatureSet;
+
+inline LayoutFeatureSet feature_bit(LayoutFeature feature) {
+  return LayoutFeatureSet(1) << feature;
+}
+
+// The features that are properties of a field, each of which takes a field of
+// its own to exercise.
+static const LayoutFeatureSet kFieldLayoutFeatures =
+    feature_bit(LayoutFeature_Bitfield) |
+    feature_bit(LayoutFeature_AnonymousBitfield) |
+    feature_bit(LayoutFeature_AlignedBitfield) |
+    feature_bit(LayoutFeature_Array) | feature_bit(LayoutFeature_AlignedField) |
+    feature_bit(LayoutFeature_ClassField) |
+    feature_bit(LayoutFeature_PMFField) | feature_bit(LayoutFeature_PDMField);
+
+const char *layout_feature_name(LayoutFeature feature);
+
+LayoutFeatureSet field_layout_features(const Class::Field &field);
+
+LayoutFeatureSet class_layout_features(const Class &type);
+
+// Which combinations of up to three layout features some class has used.  A
+// map is saved as one line per covered combination, with feature names joined
+// by '+', and saving merges with whatever is already in the file, so
+// campaigns can share one.  All methods are safe to call from several
+// threads.
+class CoverageMap {
+ public:
+  CoverageMap();
+
+  // Adds the combinations in the map at `path`, which need not exist yet.
+  // Returns false if it exists but cannot be read.
+  bool load(const std::string &path);
+
+  bool save(const std::string &path);
+
+  // Marks every combination of up to three of `features` as covered.
+  void record(LayoutFeatureSet features);
+
+  // Returns an uncovered combination chosen at random, or 0 if there is none.
+  LayoutFeatureSet pick_uncovered(RandomStream &random);
+
+  int num_covered();
+  int num_combinations() const { return combinations.size(); }
+
+ private:
+  bool add_line(const std::string &line);
+
+  std::mutex mutex;
+  // Every combination, in a fixed order, and its index in that order.
+  std::vector<LayoutFeatureSet> combinations;
+  std::unordered_map<LayoutFeatureSet, int> combination_index;
+  std::vector<char> covered;
+  int covered_count;
+};
+
+#endif
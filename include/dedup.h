@@ -0,0 +1,52 @@
+#ifndef SUPERFUZZ_DEDUP_H
+#define SUPERFUZZ_DEDUP_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "context.h"
+
+// Hashes everything about class `class_i` that can affect its layout, but
+// not its name or the names of the classes it uses: its attributes, the
+// kinds, widths and alignments of its fields, which of its methods are
+// virtual and the parameter types that decide what they override, and the
+// same for every class reachable through its bases, through fields that
+// contain or point into another class and through those parameters.  Which of those
+// classes are the same class, as with a virtual base inherited twice, is
+// part of the hash.  Classes that hash alike are laid out alike, barring
+// collisions.
+uint64_t hash_class_layout(const GenerationContext &context, int class_i);
+
+// Hashes the classes of `context` that do not have a layout hash yet.
+void update_layout_hashes(GenerationContext &context);
+
+// The layouts already tested, across programs and runs.  The index is kept
+// in a file of 64-bit hashes; layouts tested for the first time are appended
+// to it by save().
+class LayoutIndex {
+ public:
+  // Reads the index at `path`, which need not exist yet.  Returns false if it
+  // exists but cannot be read.
+  bool load(const std::string &path);
+
+  // Removes from `test_order` every class whose layout is in the index, or
+  // is tested earlier in `test_order`, and adds the layouts of the classes
+  // that remain.  `context` must have layout hashes.  Safe to call from
+  // several threads.
+  void select_untested(const GenerationContext &context,
+                       std::vector<int> &test_order);
+
+  // Appends the layouts added since load() to the index file.
+  bool save();
+
+ private:
+  std::string path;
+  std::mutex mutex;
+  std::unordered_set<uint64_t> hashes;
+  std::vector<uint64_t> added;
+};
+
+#endif
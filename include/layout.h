@@ -0,0 +1,110 @@
+#ifndef SUPERFUZZ_LAYOUT_H
+#define SUPERFUZZ_LAYOUT_H
+
+#include <vector>
+
+#include "context.h"
+#include "type.h"
+
+enum LayoutABI {
+  LayoutABI_Itanium,
+  LayoutABI_Microsoft,
+};
+
+// The record layout of one class, as a conforming x86-64 compiler for the
+// given ABI would compute it.  Sizes, alignments and base offsets are in
+// bytes; field offsets are in bits so that bitfields can be described.
+struct ClassLayout {
+  struct VBase {
+    int class_i;
+    long long offset;
+    bool has_vtordisp;
+  };
+
+  long long size;
+  long long alignment;
+  long long data_size;
+  long long nv_size;
+  long long nv_alignment;
+  long long required_alignment;
+  long long size_of_largest_empty_subobject;
+  // Indexed like Class::fields.
+  std::vector<long long> field_offsets;
+  // Indexed like Class::direct_bases; -1 for virtual bases.
+  std::vector<long long> base_offsets;
+  // Every virtual base of the complete object.
+  std::vector<VBase> vbases;
+  int primary_base;
+  bool primary_base_is_virtual;
+  bool has_own_vfptr;
+  long long vbptr_offset;
+  bool leads_with_zero_sized_base;
+  bool ends_with_zero_sized_object;
+
+  ClassLayout()
+      : size(0),
+        alignment(1),
+        data_size(0),
+        nv_size(0),
+        nv_alignment(1),
+        required_alignment(0),
+        size_of_largest_empty_subobject(0),
+        primary_base(-1),
+        primary_base_is_virtual(false),
+        has_own_vfptr(false),
+        vbptr_offset(-1),
+        leads_with_zero_sized_base(false),
+        ends_with_zero_sized_object(false) {}
+
+  const VBase *find_vbase(int class_i) const;
+};
+
+// ABI-independent facts about a class that the layout algorithms need.
+struct ClassFacts {
+  bool is_polymorphic;
+  bool is_empty;
+  bool is_pod;
+  // Whether the class could be nearly empty, going by GCC's rule: it has no
+  // fields but zero-width bitfields, and its non-virtual bases are empty but
+  // for at most one nearly empty one.  Its vptr and the offsets of its empty
+  // bases decide the rest.
+  bool is_nearly_empty;
+  // All virtual bases, direct and indirect, in the order Clang's
+  // CXXRecordDecl::vbases() visits them.
+  std::vector<int> vbases;
+  // Indexed like Class::methods.
+  std::vector<bool> method_is_virtual;
+  std::vector<bool> method_overrides;
+  // The classes that first declared the virtual function each method
+  // overrides; just this class for methods that override nothing.
+  std::vector<std::vector<int>> method_introducers;
+  // The introducers of all non-pure virtual methods.
+  std::vector<int> bases_with_overridden_methods;
+
+  bool has_vbases() const { return !vbases.empty(); }
+};
+
+// Computes the layout of every class of a generated program.  Classes only
+// refer to earlier classes, so they are laid out in index order.
+class LayoutEngine {
+ public:
+  LayoutEngine(const GenerationContext &context, LayoutABI abi);
+
+  LayoutABI get_abi() const { return abi; }
+  const ClassLayout &get_layout(int class_i) const { return layouts[class_i]; }
+  const ClassFacts &get_facts(int class_i) const { return facts[class_i]; }
+
+  // Size and alignment of a field's type, array dimensions included.
+  void get_field_type_info(const Class::Field &field, long long &size,
+                           long long &alignment) const;
+
+ private:
+  void compute_facts(const Class &type);
+
+  const GenerationContext &context;
+  LayoutABI abi;
+  std::vector<ClassFacts> facts;
+  std::vector<ClassLayout> layouts;
+};
+
+#endif
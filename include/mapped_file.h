@@ -0,0 +1,33 @@
+#ifndef SUPERFUZZ_MAPPED_FILE_H
+#define SUPERFUZZ_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// A read-only mapping of a whole file.
+class MappedFile {
+ public:
+  MappedFile() : data(nullptr), length(0) {}
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Maps `path`, replacing any mapping already held.  An empty file maps to
+  // an empty range.
+  bool map(const std::string &path);
+
+  const unsigned char *begin() const {
+    return static_cast<const unsigned char *>(data);
+  }
+  const unsigned char *end() const { return begin() + length; }
+  size_t size() const { return length; }
+
+ private:
+  void unmap();
+
+  void *data;
+  size_t length;
+};
+
+#endif
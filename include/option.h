@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -5,6 +6,9 @@
 struct OptionBase {
   virtual void set_value(const char *str) = 0;
   virtual bool requires_argument() const = 0;
+  // Remembers the current value, and goes back to the one last remembered.
+  virtual void save() = 0;
+  virtual void restore() = 0;
   virtual ~OptionBase();
 };
 
@@ -12,18 +16,22 @@ std::unordered_map<std::string, OptionBase *> &get_option_map();
 
 template <typename T> struct Option : public OptionBase {
   T value;
-  Option(const char *name, T default_value = T()) : value(default_value) {
+  T saved_value;
+  Option(const char *name, T default_value = T())
+      : value(default_value), saved_value(default_value) {
     get_option_map()[name] = this;
   }
 
   operator T() const { return value; }
   T &operator=(T val) {
     value = val;
-    return *this;
+    return value;
   }
 
   void set_value(const char *arg);
   bool requires_argument() const;
+  void save() { saved_value = value; }
+  void restore() { value = saved_value; }
 };
 template <typename T>
 inline bool Option<T>::requires_argument() const {
@@ -41,9 +49,31 @@ template <> inline void Option<unsigned long>::set_value(const char *arg) {
   if (arg[pos] != '\0')
     throw std::runtime_error("stoul: illegal character in argument string\n");
 }
+template <> inline void Option<std::string>::set_value(const char *arg) {
+  value = arg;
+}
 template <> inline bool Option<bool>::requires_argument() const { return false; }
 template <> inline void Option<bool>::set_value(const char *) { value = true; }
 
-extern void parse_options(int argc, const char *argv[]);
+// Sets the options given on the command line.  Prints the usage or the
+// problem and exits with status `error_status` if one is malformed.
+extern void parse_options(int argc, const char *argv[],
+                          int error_status = EXIT_FAILURE);
+// Sets the option `arg` names, written "--name" or "--name=value".  Returns
+// false and explains why in `error` if it cannot.
+extern bool set_option(const std::string &arg, std::string &error);
+// Saves or restores the value of every option.
+extern void save_options();
+extern void restore_options();
 extern void usage(const char *program_name);
+// Parses an inclusive range of seeds written as "first:last".
+extern bool parse_seed_range(const std::string &range, unsigned long &first,
+                             unsigned long &last);
+// The path of the program `name` next to the program run as `program_name`,
+// or just `name`, for the shell to find, if that was run without a path.
+extern std::string sibling_program(const char *program_name,
+                                   const char *name);
+// The number of jobs to run: `jobs`, or one per hardware thread if `jobs` is
+// not positive.
+extern int job_count(int jobs);
 
@@ -0,0 +1,75 @@
+#ifndef SUPERFUZZ_OUTPUT_H
+#define SUPERFUZZ_OUTPUT_H
+
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+
+// An append-only text buffer that hands its contents to a std::ostream in
+// large blocks.  Programs are emitted a few bytes at a time, so this skips
+// the sentry, locale and virtual dispatch work std::ostream does per insert
+// and formats integers in place.
+class OutputBuffer {
+ public:
+  explicit OutputBuffer(std::ostream &out, size_t capacity = 1 << 20);
+  ~OutputBuffer();
+
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+  void write(const char *data, size_t size) {
+    if (size > capacity - used) {
+      write_slow(data, size);
+      return;
+    }
+    memcpy(buffer.get() + used, data, size);
+    used += size;
+  }
+
+  void put(char c) {
+    if (used == capacity)
+      flush();
+    buffer[used++] = c;
+  }
+
+  // Hands everything buffered so far to the stream.
+  void flush();
+
+  // Bytes written through this buffer, flushed or not.
+  unsigned long long bytes_written() const { return flushed + used; }
+
+  OutputBuffer &operator<<(char c) {
+    put(c);
+    return *this;
+  }
+  OutputBuffer &operator<<(const char *str) {
+    write(str, strlen(str));
+    return *this;
+  }
+  OutputBuffer &operator<<(const std::string &str) {
+    write(str.data(), str.size());
+    return *this;
+  }
+  OutputBuffer &operator<<(int value) { return *this << (long long)value; }
+  OutputBuffer &operator<<(long value) { return *this << (long long)value; }
+  OutputBuffer &operator<<(long long value);
+  OutputBuffer &operator<<(unsigned value) {
+    return *this << (unsigned long long)value;
+  }
+  OutputBuffer &operator<<(unsigned long value) {
+    return *this << (unsigned long long)value;
+  }
+  OutputBuffer &operator<<(unsigned long long value);
+
+ private:
+  void write_slow(const char *data, size_t size);
+
+  std::ostream &out;
+  std::unique_ptr<char[]> buffer;
+  size_t capacity;
+  size_t used;
+  unsigned long long flushed;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef SUPERFUZZ_PROCESS_H
+#define SUPERFUZZ_PROCESS_H
+
+#include <string>
+
+// Runs `command` with /bin/sh and returns its exit status, or -1 if it could
+// not be started or did not exit normally (for example, it crashed).
+int run_command(const std::string &command);
+
+// What running a command took.  The peak resident set size is that of the
+// largest process the command ran, its subprocesses included.
+struct CommandUsage {
+  int status;
+  double wall_seconds;
+  double cpu_seconds;
+  long peak_rss_kb;
+};
+
+// Runs `command` like run_command() and measures it.  Returns false if it
+// could not be measured.
+bool measure_command(const std::string &command, CommandUsage &usage);
+
+// Quotes `word` so that the shell passes it through as a single argument.
+std::string shell_quote(const std::string &word);
+
+// Creates `path` unless it already exists as a directory.
+bool make_directory(const std::string &path);
+
+// Listens for connections on a UNIX socket at `path`, replacing any socket
+// already there.  Returns the listening descriptor, or -1.
+int listen_unix_socket(const std::string &path);
+
+#endif
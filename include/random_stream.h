@@ -0,0 +1,102 @@
+#ifndef SUPERFUZZ_RANDOM_STREAM_H
+#define SUPERFUZZ_RANDOM_STREAM_H
+
+#include <cstdint>
+
+#include "context.h"
+
+// The Philox4x32-10 counter-based generator (Salmon et al., "Parallel Random
+// Numbers: As Easy as 1, 2, 3").  Every 128-bit counter value is encrypted
+// under a key into four independent 32-bit outputs, so any number of
+// streams, told apart by part of the counter, can be drawn from one key
+// without any of them depending on the others.
+class Philox {
+ public:
+  typedef uint32_t result_type;
+
+  // Draws from stream `stream` of `key`.
+  Philox(uint64_t key, uint64_t stream)
+      : key{uint32_t(key), uint32_t(key >> 32)},
+        counter{0, 0, uint32_t(stream), uint32_t(stream >> 32)},
+        used(4) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return 0xffffffff; }
+
+  result_type operator()() {
+    if (used == 4)
+      refill();
+    return block[used++];
+  }
+
+ private:
+  void refill() {
+    uint32_t x[4] = {counter[0], counter[1], counter[2], counter[3]};
+    uint32_t k[2] = {key[0], key[1]};
+    for (int round = 0; round < 10; ++round) {
+      uint64_t product0 = uint64_t(0xd2511f53) * x[0];
+      uint64_t product1 = uint64_t(0xcd9e8d57) * x[2];
+      uint32_t next[4] = {uint32_t(product1 >> 32) ^ x[1] ^ k[0],
+                          uint32_t(product1),
+                          uint32_t(product0 >> 32) ^ x[3] ^ k[1],
+                          uint32_t(product0)};
+      for (int word = 0; word < 4; ++word)
+        x[word] = next[word];
+      k[0] += 0x9e3779b9;
+      k[1] += 0xbb67ae85;
+    }
+    for (int word = 0; word < 4; ++word)
+      block[word] = x[word];
+    // The low half of the counter numbers the blocks of a stream.
+    if (++counter[0] == 0)
+      ++counter[1];
+    used = 0;
+  }
+
+  uint32_t key[2];
+  uint32_t counter[4];
+  uint32_t block[4];
+  int used;
+};
+
+// Where in the generation of a class a decision is made.  With counter-based
+// streams each site draws from a stream of its own, so changing how many
+// numbers one site draws leaves the others alone.
+enum RandomSite {
+  RandomSite_Bases,
+  RandomSite_Fields,
+  RandomSite_Methods,
+  RandomSite_Attributes,
+  RandomSite_Coverage,
+  RandomSite_TestOrder,
+};
+
+// What the generator draws decisions from: either the context's sequential
+// generator, shared by every decision, or a counter-based stream keyed by
+// the seed, a class and a site.  Both produce 32-bit values over the same
+// range, so the standard distributions turn the sequential generator's
+// numbers into exactly the decisions they did before.
+class RandomStream {
+ public:
+  typedef uint32_t result_type;
+
+  explicit RandomStream(generator_type &sequential)
+      : sequential(&sequential), counter_based(0, 0) {}
+
+  RandomStream(unsigned long seed, uint32_t class_i, RandomSite site)
+      : sequential(nullptr),
+        counter_based(seed, uint64_t(site) << 32 | class_i) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return 0xffffffff; }
+
+  result_type operator()() {
+    return sequential ? result_type((*sequential)()) : counter_based();
+  }
+
+ private:
+  generator_type *sequential;
+  Philox counter_based;
+};
+
+#endif
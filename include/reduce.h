@@ -0,0 +1,67 @@
+#ifndef SUPERFUZZ_REDUCE_H
+#define SUPERFUZZ_REDUCE_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "context.h"
+
+// One thing to delete from, or reset in, a generated program.
+struct Reduction {
+  enum Kind {
+    Kind_RemoveClass,
+    Kind_RemoveBase,
+    Kind_RemoveMethod,
+    Kind_RemoveField,
+    Kind_RemoveArrayDimension,
+    Kind_RemoveBitfieldWidth,
+    Kind_RemoveFieldAlignment,
+    Kind_RemovePacked,
+    Kind_RemoveAlignment,
+    Kind_RemoveVtordisp,
+  };
+
+  Kind kind;
+  int class_i;
+  // The base, method or field the reduction applies to, by position.
+  int index;
+};
+
+// Appends every reduction that applies to the program in `context`, coarsest
+// first.
+void enumerate_reductions(const GenerationContext &context,
+                          std::vector<Reduction> &reductions);
+
+// Copies the program in `from`, which tests its classes in `from_order`, into
+// the empty context `to` with `reduction` applied.  Everything that refers to
+// a removed class goes with it, and later classes are renumbered, so the
+// result only ever refers to classes that exist.
+void apply_reduction(const GenerationContext &from,
+                     const std::vector<int> &from_order,
+                     const Reduction &reduction, GenerationContext &to,
+                     std::vector<int> &to_order);
+
+// Copies class `slice_class` of `from` into the empty context `to` along with
+// every class it needs: its bases and the classes its fields and methods
+// name.  `to_order` tests only `slice_class`.  The copied classes keep their
+// relative order but are renumbered from 0.
+void slice_program(const GenerationContext &from, int slice_class,
+                   GenerationContext &to, std::vector<int> &to_order);
+
+// Decides whether a candidate program still shows the behavior being
+// reduced.  It is called from up to `num_jobs` threads at once; `slot` is
+// unique among the concurrent calls.
+typedef std::function<bool(GenerationContext &candidate,
+                           const std::vector<int> &test_order, int slot)>
+    InterestingnessTest;
+
+// Greedily applies reductions that keep the program interesting until no
+// single reduction does, testing up to `num_jobs` candidates at a time.
+// Among the candidates tested together, the first interesting one in
+// enumeration order wins, so the result does not depend on timing.
+void reduce_program(std::unique_ptr<GenerationContext> &context,
+                    std::vector<int> &test_order, int num_jobs,
+                    const InterestingnessTest &is_interesting);
+
+#endif
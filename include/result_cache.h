@@ -0,0 +1,59 @@
+#ifndef SUPERFUZZ_RESULT_CACHE_H
+#define SUPERFUZZ_RESULT_CACHE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Hashes `parts`, each length-prefixed so that no two lists of parts collide
+// by concatenation, into 32 hex digits.
+std::string content_hash(const std::vector<std::string> &parts);
+
+// What compiling and running one program with one compiler produced.
+struct CachedResult {
+  int compile_status;
+  int run_status;
+  // The program's output, or the compiler's if it failed.
+  std::string output;
+};
+
+// Results of earlier compiles and runs, keyed by content_hash() of the
+// program and the compiler.  The cache is a single append-only file of
+// checksummed records, each appended with one write() to a descriptor opened
+// with O_APPEND, so any number of processes can add to it at once.  A
+// record torn by a crashed writer fails its checksum and is skipped.
+class ResultCache {
+ public:
+  ResultCache() : fd(-1), scanned(0) {}
+  ~ResultCache();
+
+  ResultCache(const ResultCache &) = delete;
+  ResultCache &operator=(const ResultCache &) = delete;
+
+  // Opens the cache at `path`, creating it if needed.
+  bool open(const std::string &path);
+
+  // Looks `key` up, including among records other processes appended since
+  // the last lookup.
+  bool lookup(const std::string &key, CachedResult &result);
+
+  bool store(const std::string &key, const CachedResult &result);
+
+ private:
+  struct Entry {
+    uint64_t offset;
+    uint32_t size;
+  };
+
+  // Indexes the records appended since the last scan.
+  void scan();
+
+  int fd;
+  uint64_t scanned;
+  std::mutex mutex;
+  std::unordered_map<std::string, Entry> entries;
+};
+
+#endif
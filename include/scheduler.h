@@ -0,0 +1,63 @@
+#ifndef SUPERFUZZ_SCHEDULER_H
+#define SUPERFUZZ_SCHEDULER_H
+
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// Spreads the seeds of a campaign over arms, each a set of extra generator
+// arguments, in favor of the arms that find the most new distinct mismatches
+// per second of generating, compiling and running.  Each arm's rate is
+// modeled as a Poisson process with a Gamma prior, and every seed goes to the
+// arm whose rate drawn from its posterior is highest (Thompson sampling).
+//
+// Decisions and outcomes can be logged, one per line:
+//   arm <index> <arguments>
+//   choose <seed> <arm>
+//   outcome <seed> <arm> <seconds> <new mismatches>
+// Replaying such a log gives every seed it chose for the same arm.  The
+// scheduler is not thread-safe.
+class ArmScheduler {
+ public:
+  explicit ArmScheduler(unsigned long random_seed) : random(random_seed) {}
+
+  // Reads the arms from `path`, one line of arguments each; blank lines and
+  // lines starting with '#' are skipped.
+  bool load_arms(const std::string &path, std::string &error);
+
+  // Takes the choices from the log at `path` instead of drawing them, for
+  // the seeds it has choices for.
+  bool load_replay(const std::string &path, std::string &error);
+
+  bool open_log(const std::string &path);
+
+  int num_arms() const { return arms.size(); }
+  const std::string &arm_arguments(int arm) const {
+    return arms[arm].arguments;
+  }
+
+  int choose(unsigned long seed);
+
+  // Credits `arm` with the time spent on one of its seeds and how many new
+  // distinct mismatches the seed found.
+  void report(unsigned long seed, int arm, double seconds, int num_new);
+
+  void print_summary(std::ostream &out) const;
+
+ private:
+  struct Arm {
+    std::string arguments;
+    unsigned long num_seeds;
+    double seconds;
+    unsigned long num_new;
+  };
+
+  std::vector<Arm> arms;
+  std::map<unsigned long, int> replay;
+  std::mt19937_64 random;
+  std::ofstream log;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef SUPERFUZZ_SNAPSHOT_H
+#define SUPERFUZZ_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+
+#include "context.h"
+
+// A snapshot holds the class model of one program and the order its classes
+// are tested in, so that the program can be emitted again, sliced or reduced
+// without regenerating it.  Snapshots are versioned; a reader rejects any
+// version it does not know.
+//
+// Layout: the 8 magic bytes "SFZSNAP\0", then unsigned LEB128 varints:
+//   version, flags, seed, [swarm chance count, swarm chances...],
+//   class count,
+//   per class: alignment+1, packed+1, vtordisp+1, class flags,
+//     base count, per base: base << 1 | is_virtual,
+//     field count, per field: type, [type_class], bitfield_width+1,
+//       alignment+1, field flags, dimension count, dimensions...,
+//     method count, per method: name_class+1, ret_type, [ret_type_class],
+//       arg_type, [arg_type_class], method flags,
+//   test count, test order...
+// Bracketed class indices are present only for class-valued type kinds, and
+// the swarm chances only with --swarm.  Version 1 had no swarm chances.
+static const unsigned kSnapshotVersion = 2;
+
+// What emitting a snapshot needs besides the model.
+struct SnapshotInfo {
+  unsigned long seed;
+  bool gnu_dialect;
+  bool check_vptrs;
+  // With --swarm, the chances the program was generated with, in the order
+  // superfuzz lists its swarm options, and whether it allowed PMF and PDM
+  // fields, so that its header can be written again as it was.
+  bool swarm;
+  std::vector<int> swarm_chances;
+  bool pmf_fields;
+  bool pdm_fields;
+};
+
+// Writes the program in `context` to `path`.  Returns false if the file
+// could not be written.
+bool write_snapshot(const std::string &path, const GenerationContext &context,
+                    const std::vector<int> &test_order,
+                    const SnapshotInfo &info);
+
+// Maps the snapshot at `path` and rebuilds its program in the empty context
+// `context`.  On failure, returns false and describes why in `error`.
+bool read_snapshot(const std::string &path, GenerationContext &context,
+                   std::vector<int> &test_order, SnapshotInfo &info,
+                   std::string &error);
+
+#endif
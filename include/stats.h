@@ -0,0 +1,96 @@
+#ifndef SUPERFUZZ_STATS_H
+#define SUPERFUZZ_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#include "type.h"
+
+// The parts of generating a program that are timed separately.
+enum GenerationPhase {
+  GenerationPhase_Bases,
+  GenerationPhase_Fields,
+  GenerationPhase_Methods,
+  GenerationPhase_Attributes,
+  GenerationPhase_Emission,
+  GenerationPhase_Count,
+};
+
+// What generation did and where its time went, kept only with --stats.
+// Every job counts into its own, and they are merged at the end.
+struct GenerationStats {
+  uint64_t phase_nanoseconds[GenerationPhase_Count];
+  uint64_t programs;
+  uint64_t classes;
+  uint64_t bases;
+  uint64_t virtual_bases;
+  // Bases is_viable_base() turned down.
+  uint64_t rejected_bases;
+  uint64_t fields_by_kind[TypeKind_Class + 1];
+  uint64_t bitfields;
+  uint64_t anonymous_bitfields;
+  uint64_t array_fields;
+  uint64_t aligned_fields;
+  uint64_t own_methods;
+  uint64_t override_methods;
+  uint64_t virtual_methods;
+  uint64_t pure_methods;
+  uint64_t packed_classes;
+  uint64_t aligned_classes;
+  uint64_t vtordisp_classes;
+  uint64_t classes_with_ctor;
+  uint64_t bytes_emitted;
+  // The most memory the arenas of one job held, summed over the jobs.
+  uint64_t peak_arena_bytes;
+
+  GenerationStats();
+
+  // Counts the bases, fields, methods and attributes of a finished class.
+  void count_class(const Class &type);
+
+  void merge(const GenerationStats &other);
+
+  void write_json(std::ostream &out, double wall_seconds) const;
+};
+
+// Charges the time until the next call to start() or stop(), or until it is
+// destroyed, to the phase last started.  Does nothing without stats.
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(GenerationStats *stats)
+      : stats(stats), phase(GenerationPhase_Count) {}
+  ~PhaseTimer() { stop(); }
+
+  void start(GenerationPhase next) {
+    if (!stats)
+      return;
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    charge(now);
+    phase = next;
+    phase_start = now;
+  }
+
+  void stop() {
+    if (!stats || phase == GenerationPhase_Count)
+      return;
+    charge(std::chrono::steady_clock::now());
+    phase = GenerationPhase_Count;
+  }
+
+ private:
+  void charge(std::chrono::steady_clock::time_point now) {
+    if (phase != GenerationPhase_Count)
+      stats->phase_nanoseconds[phase] +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(now -
+                                                               phase_start)
+              .count();
+  }
+
+  GenerationStats *stats;
+  GenerationPhase phase;
+  std::chrono::steady_clock::time_point phase_start;
+};
+
+#endif
@@ -1,8 +1,14 @@
-#include <string>
-#include <sstream>
-#include <unordered_set>
+#ifndef SUPERFUZZ_TYPE_H
+#define SUPERFUZZ_TYPE_H
+
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 
+#include "arena.h"
+#include "context.h"
+#include "output.h"
+
 enum TypeKind {
   TypeKind_Bool,
   TypeKind_Char,
@@ -17,11 +23,97 @@ enum TypeKind {
   TypeKind_Class,
 };
 
-extern std::vector<struct Class *> types;
+// The kind a method's parameter type is compared by when deciding whether
+// the method overrides another: `int (C::*)` and `int C::*` name the same
+// type.
+inline TypeKind canonical_parameter_kind(TypeKind kind) {
+  return kind == TypeKind_PMF ? TypeKind_PDM : kind;
+}
+
+// Names that render straight into an OutputBuffer, so emitting a reference
+// to a class or field does not build a std::string.
+struct ClassName {
+  int class_i;
+};
+
+struct FieldName {
+  int class_i;
+  int field_i;
+};
+
+OutputBuffer &operator<<(OutputBuffer &out, ClassName name);
+OutputBuffer &operator<<(OutputBuffer &out, FieldName name);
+
+// A set of class indices, one bit per class.  Classes only ever refer to
+// earlier classes, so the sets of class N never span more than N bits and
+// generating a program stays quadratic in bits rather than in hash nodes.
+class ClassSet {
+ public:
+  explicit ClassSet(Arena &arena) : words(arena) {}
+
+  bool contains(int class_i) const {
+    size_t word = class_i / kBitsPerWord;
+    return word < words.size() &&
+           ((words[word] >> (class_i % kBitsPerWord)) & 1) != 0;
+  }
+
+  void insert(int class_i) {
+    size_t word = class_i / kBitsPerWord;
+    if (word >= words.size())
+      words.resize(word + 1);
+    words[word] |= uint64_t(1) << (class_i % kBitsPerWord);
+  }
+
+  void insert_all(const ClassSet &other) {
+    if (other.words.size() > words.size())
+      words.resize(other.words.size());
+    for (size_t i = 0; i < other.words.size(); ++i)
+      words[i] |= other.words[i];
+  }
 
-struct Class {
+  // Inserts the members of `other` that are also members of `mask` or
+  // `other_mask`.  Either mask may be this set.
+  void insert_all_masked(const ClassSet &other, const ClassSet &mask,
+                         const ClassSet &other_mask) {
+    size_t size = std::min(other.words.size(),
+                           std::max(mask.words.size(), other_mask.words.size()));
+    size_t mask_size = mask.words.size();
+    size_t other_mask_size = other_mask.words.size();
+    if (size > words.size())
+      words.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+      uint64_t masks = (i < mask_size ? mask.words[i] : 0) |
+                       (i < other_mask_size ? other_mask.words[i] : 0);
+      words[i] |= other.words[i] & masks;
+    }
+  }
+
+  bool intersects(const ClassSet &other) const {
+    size_t size = std::min(words.size(), other.words.size());
+    for (size_t i = 0; i < size; ++i)
+      if ((words[i] & other.words[i]) != 0)
+        return true;
+    return false;
+  }
+
+ private:
+  static const int kBitsPerWord = 64;
+  ArenaVector<uint64_t> words;
+};
+
+// Every base, direct or indirect, that a class inherits virtually (vbases)
+// or non-virtually (nvbases) somewhere in its hierarchy.  This is all that
+// generating later classes needs from it, and all that --stream keeps.
+struct BaseClosure {
+  ClassSet vbases;
+  ClassSet nvbases;
+
+  explicit BaseClosure(Arena &arena) : vbases(arena), nvbases(arena) {}
+};
+
+struct Class : BaseClosure {
   struct Field {
-    std::vector<int> array_dimensions;
+    ArenaVector<int> array_dimensions;
     TypeKind type;
     int field_i;
     int class_i;
@@ -30,8 +122,9 @@ struct Class {
     int type_class;
     bool is_anonymous;
     bool gnu_alignment_spelling;
-    Field(TypeKind ty, int fi, int ci)
-        : type(ty),
+    Field(TypeKind ty, int fi, int ci, Arena &arena)
+        : array_dimensions(arena),
+          type(ty),
           field_i(fi),
           class_i(ci),
           bitfield_width(-1),
@@ -81,28 +174,41 @@ struct Class {
       return *this;
     }
 
-    std::string get_field_name() const;
+    FieldName get_name() const { return FieldName{class_i, field_i}; }
 
-    friend std::ostream &operator<<(std::ostream &stream, const Field &field);
+    friend OutputBuffer &operator<<(OutputBuffer &stream,
+                                    const InContext<Field> &field);
   };
 
-  std::unordered_set<int> indirect_vbases;
-  std::unordered_set<int> indirect_nvbases;
-  std::unordered_set<int> direct_vbases;
-  std::unordered_set<int> direct_nvbases;
-  std::vector<int> direct_bases;
-  std::vector<Field *> fields;
+  ClassSet direct_vbases;
+  // The direct bases that a new base must not inherit non-virtually
+  // (respectively virtually), since that would make the base ambiguous.
+  ClassSet nonvirtual_conflicts;
+  ClassSet virtual_conflicts;
+  ArenaVector<int> direct_bases;
+  ArenaVector<Field> fields;
   struct Method {
-    std::string name;
+    // Methods introduced by a class are named after it; -1 names the
+    // override method every class may declare.
+    int name_class;
     TypeKind ret_type;
     int ret_type_class;
     bool is_virtual;
     bool is_pure;
     TypeKind arg_type;
     int arg_type_class;
-    friend std::ostream &operator<<(std::ostream &stream, const Method &method);
+    Method()
+        : name_class(-1),
+          ret_type(TypeKind_Bool),
+          ret_type_class(-1),
+          is_virtual(false),
+          is_pure(false),
+          arg_type(TypeKind_Bool),
+          arg_type_class(-1) {}
+    friend OutputBuffer &operator<<(OutputBuffer &stream,
+                                    const InContext<Method> &method);
   };
-  std::vector<Method> methods;
+  ArenaVector<Method> methods;
   int class_i;
   int alignment;
   int packed;
@@ -111,8 +217,17 @@ struct Class {
   bool has_ctor;
   bool has_dllexport;
 
-  Class(int ci)
-      : class_i(ci),
+  // Classes are created in, and everything they own is allocated from, the
+  // arena of their GenerationContext.
+  Class(int ci, Arena &arena)
+      : BaseClosure(arena),
+        direct_vbases(arena),
+        nonvirtual_conflicts(arena),
+        virtual_conflicts(arena),
+        direct_bases(arena),
+        fields(arena),
+        methods(arena),
+        class_i(ci),
         alignment(-1),
         packed(-1),
         vtordisp(-1),
@@ -120,15 +235,23 @@ struct Class {
         has_ctor(false),
         has_dllexport(false) {}
 
-  bool is_viable_base(int new_base) const;
+  bool is_viable_base(const GenerationContext &context, int new_base) const;
 
-  void add_base(int base, bool is_virtual);
+  void add_base(const GenerationContext &context, int base, bool is_virtual);
 
   bool has_base(int base, bool is_virtual) const;
 
+  // Copies the base closure into `arena`, for when the class itself goes.
+  BaseClosure *summarize(Arena &arena) const;
+
+  bool is_direct_vbase(int base) const {
+    return direct_vbases.contains(base);
+  }
+
   Field &add_field(TypeKind tk) {
-    fields.push_back(new Field(tk, fields.size(), class_i));
-    return *fields.back();
+    fields.push_back(Field(tk, fields.size(), class_i,
+                           *fields.get_allocator().arena));
+    return fields.back();
   }
 
   void set_packed(int pack) {
@@ -156,7 +279,16 @@ struct Class {
     methods.push_back(meth);
   }
 
-  std::string get_class_name() const;
+  ClassName get_name() const { return ClassName{class_i}; }
 
-  friend std::ostream &operator<<(std::ostream &stream, const Class &type);
+  friend OutputBuffer &operator<<(OutputBuffer &stream,
+                                  const InContext<Class> &type);
 };
+
+// Appends `type`, the next class, to the classes of `context`.
+inline void append_class(GenerationContext &context, Class *type) {
+  context.types.push_back(type);
+  context.base_closures.push_back(type);
+}
+
+#endif
@@ -0,0 +1,37 @@
+#include "alias_table.h"
+
+AliasTable::AliasTable(const std::vector<int> &weights)
+    : thresholds(weights.size()),
+      aliases(weights.size()),
+      total_weight(0),
+      column_dist(0, int(weights.size()) - 1) {
+  for (int weight : weights)
+    total_weight += weight;
+  height_dist = std::uniform_int_distribution<uint64_t>(0, total_weight - 1);
+
+  // Scaled by the number of columns, an index's weight is how much of a
+  // column of height total_weight it fills.  Indices that fill less than a
+  // column give the rest of theirs to one that fills more.
+  std::vector<int> small, large;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    thresholds[i] = uint64_t(weights[i]) * weights.size();
+    aliases[i] = i;
+    (thresholds[i] < total_weight ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    int less = small.back();
+    small.pop_back();
+    int more = large.back();
+    aliases[less] = more;
+    thresholds[more] -= total_weight - thresholds[less];
+    if (thresholds[more] < total_weight) {
+      large.pop_back();
+      small.push_back(more);
+    }
+  }
+  // Whatever is left fills its column exactly.
+  for (int i : large)
+    thresholds[i] = total_weight;
+  for (int i : small)
+    thresholds[i] = total_weight;
+}
@@ -0,0 +1,38 @@
+#include "arena.h"
+
+#include <algorithm>
+
+static const size_t kMinBlockSize = 1 << 20;
+
+void Arena::reset() {
+  current_block = 0;
+  ptr = blocks.empty() ? nullptr : blocks[0].memory.get();
+  end = blocks.empty() ? nullptr : ptr + blocks[0].size;
+}
+
+size_t Arena::bytes_reserved() const {
+  size_t total = 0;
+  for (const Block &block : blocks)
+    total += block.size;
+  return total;
+}
+
+void *Arena::allocate_slow(size_t size, size_t alignment) {
+  // Move on to the next block that can hold the request, allocating a new
+  // one once the blocks kept from earlier programs run out.
+  size_t next_block = ptr ? current_block + 1 : current_block;
+  while (next_block < blocks.size() &&
+         blocks[next_block].size < size + alignment)
+    ++next_block;
+  if (next_block == blocks.size()) {
+    size_t block_size = std::max(kMinBlockSize, size + alignment);
+    if (!blocks.empty())
+      block_size = std::max(block_size, blocks.back().size);
+    blocks.push_back(Block{std::unique_ptr<char[]>(new char[block_size]),
+                           block_size});
+  }
+  current_block = next_block;
+  ptr = blocks[current_block].memory.get();
+  end = ptr + blocks[current_block].size;
+  return allocate(size, alignment);
+}
@@ -0,0 +1,97 @@
+#include "captured_layout.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// Parses "<name><separator><number>" spanning [begin, end), where `name`
+// runs up to the first `separator`.
+static bool parse_named_number(const char *begin, const char *end,
+                               const char *separator, LayoutLine &line) {
+  const char *separator_end = separator + strlen(separator);
+  const char *separator_pos =
+      std::search(begin, end, separator, separator_end);
+  if (separator_pos == end || separator_pos == begin)
+    return false;
+  const char *digits = separator_pos + (separator_end - separator);
+  if (digits == end)
+    return false;
+  unsigned long long value = 0;
+  for (const char *digit = digits; digit != end; ++digit) {
+    if (*digit < '0' || *digit > '9')
+      return false;
+    value = value * 10 + (*digit - '0');
+  }
+  line.name = begin;
+  line.name_length = separator_pos - begin;
+  line.value = value;
+  return true;
+}
+
+bool parse_layout_line(const char *begin, const char *end, LayoutLine &line) {
+  static const struct {
+    const char *prefix;
+    LayoutLineKind kind;
+  } kClassLines[] = {
+      {"sizeof(", LayoutLine_Size},
+      {"__alignof__(", LayoutLine_Alignment},
+      {"__alignof(", LayoutLine_Alignment},
+  };
+  if (begin != end && end[-1] == '\r')
+    --end;
+  while (begin != end && *begin == ' ')
+    ++begin;
+  for (const auto &class_line : kClassLines) {
+    size_t prefix_length = strlen(class_line.prefix);
+    if (size_t(end - begin) >= prefix_length &&
+        memcmp(begin, class_line.prefix, prefix_length) == 0) {
+      line.kind = class_line.kind;
+      return parse_named_number(begin + prefix_length, end, "): ", line);
+    }
+  }
+  line.kind = LayoutLine_FieldOffset;
+  return parse_named_number(begin, end, " : ", line);
+}
+
+bool read_captured_layouts(const std::string &path, CapturedLayouts &layouts,
+                           std::string &error) {
+  std::ifstream in(path);
+  if (!in) {
+    error = "could not read " + path;
+    return false;
+  }
+  std::vector<std::pair<std::string, unsigned long long>> pending_fields;
+  std::string line;
+  while (std::getline(in, line)) {
+    LayoutLine parsed;
+    if (!parse_layout_line(line.data(), line.data() + line.size(), parsed))
+      continue;
+    std::string name(parsed.name, parsed.name_length);
+    if (parsed.kind == LayoutLine_Size) {
+      CapturedLayout &layout = layouts[name];
+      // A class is tested once; keep the first test if it was not.
+      if (layout.has_size)
+        continue;
+      layout.has_size = true;
+      layout.size = parsed.value;
+      std::string own_prefix = name + "FieldName";
+      size_t own_begin = pending_fields.size();
+      while (own_begin > 0 &&
+             pending_fields[own_begin - 1].first.compare(
+                 0, own_prefix.size(), own_prefix) == 0)
+        --own_begin;
+      layout.field_offsets.assign(pending_fields.begin() + own_begin,
+                                  pending_fields.end());
+      pending_fields.clear();
+    } else if (parsed.kind == LayoutLine_Alignment) {
+      CapturedLayout &layout = layouts[name];
+      if (!layout.has_alignment) {
+        layout.has_alignment = true;
+        layout.alignment = parsed.value;
+      }
+    } else {
+      pending_fields.emplace_back(name, parsed.value);
+    }
+  }
+  return true;
+}
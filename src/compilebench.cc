@@ -0,0 +1,206 @@
+// Measures how a compiler's frontend scales with the shape of its input.
+// Generates families of programs that grow along one axis at a time (the
+// number of classes, the depth of inheritance, the virtual bases per class,
+// the fields per class or the nesting of arrays), times the compiler on each
+// program and reports compile time and peak memory as CSV, one row per
+// program, so that each axis can be plotted as a curve.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "option.h"
+#include "process.h"
+
+static Option<std::string> compiler("compiler", "c++ -fsyntax-only");
+// One of the axes below, or "all".
+static Option<std::string> axis_name("axis", "all");
+// Comma-separated values to scale the axis through instead of its defaults.
+static Option<std::string> values("values");
+// Every point of a curve is measured on the programs of these seeds.
+static Option<std::string> seed_range("seed-range", "1:3");
+// Compile every program this many times and keep the fastest run.
+static Option<int> repeat("repeat", 1);
+// Defaults to the superfuzz next to this executable.
+static Option<std::string> generator("generator");
+static Option<std::string> generator_args(
+    "generator-args", "--gnu-dialect --chance-of-pure-virt=0");
+static Option<std::string> work_dir("work-dir", "compilebench-work");
+// Write the CSV here instead of to stdout.
+static Option<std::string> output("output");
+static Option<bool> show_help("help", false);
+
+// An axis is scaled by substituting each of its values for "{}" in its
+// generator arguments.  Everything else stays at the generator's defaults.
+struct Axis {
+  const char *name;
+  const char *arguments;
+  std::vector<int> default_values;
+};
+
+static const Axis kAxes[] = {
+    {"classes", "--num-classes={}", {10, 20, 40, 80, 160}},
+    // Every class derives from the one before it and from nothing else.
+    {"depth",
+     "--base-chain --chance-of-base=0 --num-classes={}",
+     {8, 16, 32, 64, 128}},
+    // The chance of each earlier class being a base, all of them virtual.
+    {"vbase-fan-in",
+     "--num-classes=40 --chance-of-base={} --chance-of-vbase=100",
+     {5, 10, 20, 40, 80}},
+    {"fields",
+     "--num-classes=20 --min-num-fields={} --max-num-fields={}",
+     {8, 16, 32, 64, 128}},
+    // The chance of a field being an array, and of each array dimension
+    // having another, so the expected nesting grows with it.
+    {"array-nesting",
+     "--num-classes=20 --chance-of-array={}",
+     {10, 30, 50, 70, 90}},
+};
+
+static std::string substitute(const std::string &arguments, int value) {
+  std::string result = arguments;
+  std::string text = std::to_string(value);
+  size_t pos;
+  while ((pos = result.find("{}")) != std::string::npos)
+    result.replace(pos, 2, text);
+  return result;
+}
+
+static bool parse_values(const std::string &list, std::vector<int> &parsed) {
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    char *end;
+    long value = strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end || value < 0)
+      return false;
+    parsed.push_back(value);
+  }
+  return !parsed.empty();
+}
+
+static long file_size(const std::string &path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  return in ? long(in.tellg()) : -1;
+}
+
+int main(int argc, const char *argv[]) {
+  parse_options(argc, argv);
+
+  if (show_help) {
+    usage(argv[0]);
+    return EXIT_SUCCESS;
+  }
+
+  unsigned long first_seed, last_seed;
+  if (!parse_seed_range(seed_range, first_seed, last_seed)) {
+    std::cerr << argv[0] << ": --seed-range must be first:last\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<const Axis *> axes;
+  for (const Axis &axis : kAxes) {
+    if (std::string(axis_name) == "all" ||
+        std::string(axis_name) == axis.name)
+      axes.push_back(&axis);
+  }
+  if (axes.empty()) {
+    std::cerr << argv[0] << ": unknown --axis " << std::string(axis_name)
+              << '\n';
+    return EXIT_FAILURE;
+  }
+  std::vector<int> override_values;
+  if (!std::string(values).empty()) {
+    if (axes.size() != 1 || !parse_values(values, override_values)) {
+      std::cerr << argv[0]
+                << ": --values must be a list of numbers for a single axis\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::string generator_path = generator;
+  if (generator_path.empty())
+    generator_path = sibling_program(argv[0], "superfuzz");
+
+  if (!make_directory(work_dir)) {
+    std::cerr << argv[0] << ": could not create " << std::string(work_dir)
+              << '\n';
+    return EXIT_FAILURE;
+  }
+
+  std::ofstream output_file;
+  if (!std::string(output).empty()) {
+    output_file.open(output);
+    if (!output_file) {
+      std::cerr << argv[0] << ": could not write " << std::string(output)
+                << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+  std::ostream &csv = output_file.is_open() ? output_file : std::cout;
+  csv << "axis,value,seed,bytes,wall_seconds,cpu_seconds,peak_rss_kb,status\n";
+  csv << std::fixed;
+
+  int num_failed = 0;
+  for (const Axis *axis : axes) {
+    const std::vector<int> &axis_values =
+        override_values.empty() ? axis->default_values : override_values;
+    for (int value : axis_values) {
+      // Stops at last_seed itself, which may be ULONG_MAX.
+      for (unsigned long seed = first_seed;; ++seed) {
+        std::string stem = std::string(work_dir) + '/' + axis->name + '-' +
+                           std::to_string(value) + '-' + std::to_string(seed);
+        std::string source = stem + ".cc";
+        std::string log = stem + ".log";
+        int status = run_command(
+            shell_quote(generator_path) + " --seed=" + std::to_string(seed) +
+            ' ' + std::string(generator_args) + ' ' +
+            substitute(axis->arguments, value) + " > " + shell_quote(source));
+        if (status != 0) {
+          std::cerr << argv[0] << ": generating " << source << " failed\n";
+          return EXIT_FAILURE;
+        }
+
+        CommandUsage best;
+        for (int run = 0; run < std::max(1, int(repeat)); ++run) {
+          CommandUsage usage;
+          if (!measure_command(std::string(compiler) + ' ' +
+                                   shell_quote(source) + " > " +
+                                   shell_quote(log) + " 2>&1",
+                               usage)) {
+            std::cerr << argv[0] << ": could not run " << std::string(compiler)
+                      << '\n';
+            return EXIT_FAILURE;
+          }
+          if (run == 0 || usage.wall_seconds < best.wall_seconds)
+            best = usage;
+        }
+        // A program the compiler rejects still costs it time, but its row is
+        // marked so that it can be left out of the curve.
+        if (best.status != 0)
+          ++num_failed;
+        csv << axis->name << ',' << value << ',' << seed << ','
+            << file_size(source) << ',' << std::setprecision(4)
+            << best.wall_seconds << ',' << best.cpu_seconds << ','
+            << best.peak_rss_kb << ',' << best.status << '\n';
+        csv.flush();
+        if (seed == last_seed)
+          break;
+      }
+    }
+  }
+
+  if (num_failed) {
+    std::cerr << argv[0] << ": " << num_failed
+              << " programs did not compile; see the logs in "
+              << std::string(work_dir) << '\n';
+  }
+  return EXIT_SUCCESS;
+}
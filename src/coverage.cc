@@ -0,0 +1,206 @@
+#include "coverage.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+static const char *const kLayoutFeatureNames[LayoutFeature_Count] = {
+    "NonvirtualBase",
+    "VirtualBase",
+    "MultipleBases",
+    "Packed",
+    "Aligned",
+    "Vtordisp",
+    "Bitfield",
+    "AnonymousBitfield",
+    "AlignedBitfield",
+    "Array",
+    "AlignedField",
+    "ClassField",
+    "PMFField",
+    "PDMField",
+    "VirtualMethod",
+    "PureMethod",
+};
+
+const char *layout_feature_name(LayoutFeature feature) {
+  return kLayoutFeatureNames[feature];
+}
+
+LayoutFeatureSet field_layout_features(const Class::Field &field) {
+  LayoutFeatureSet features = 0;
+  if (field.bitfield_width > -1) {
+    features |= feature_bit(LayoutFeature_Bitfield);
+    if (field.is_anonymous)
+      features |= feature_bit(LayoutFeature_AnonymousBitfield);
+    if (field.alignment > -1)
+      features |= feature_bit(LayoutFeature_AlignedBitfield);
+  }
+  if (!field.array_dimensions.empty())
+    features |= feature_bit(LayoutFeature_Array);
+  if (field.alignment > -1)
+    features |= feature_bit(LayoutFeature_AlignedField);
+  if (field.type == TypeKind_Class)
+    features |= feature_bit(LayoutFeature_ClassField);
+  else if (field.type == TypeKind_PMF)
+    features |= feature_bit(LayoutFeature_PMFField);
+  else if (field.type == TypeKind_PDM)
+    features |= feature_bit(LayoutFeature_PDMField);
+  return features;
+}
+
+LayoutFeatureSet class_layout_features(const Class &type) {
+  LayoutFeatureSet features = 0;
+  for (int base : type.direct_bases)
+    features |= feature_bit(type.is_direct_vbase(base)
+                                ? LayoutFeature_VirtualBase
+                                : LayoutFeature_NonvirtualBase);
+  if (type.direct_bases.size() > 1)
+    features |= feature_bit(LayoutFeature_MultipleBases);
+  if (type.packed > -1)
+    features |= feature_bit(LayoutFeature_Packed);
+  if (type.alignment > -1)
+    features |= feature_bit(LayoutFeature_Aligned);
+  if (type.vtordisp > -1)
+    features |= feature_bit(LayoutFeature_Vtordisp);
+  for (const Class::Field &field : type.fields)
+    features |= field_layout_features(field);
+  for (const Class::Method &method : type.methods) {
+    if (method.is_virtual)
+      features |= feature_bit(LayoutFeature_VirtualMethod);
+    if (method.is_pure)
+      features |= feature_bit(LayoutFeature_PureMethod);
+  }
+  return features;
+}
+
+CoverageMap::CoverageMap() : covered_count(0) {
+  for (int first = 0; first < LayoutFeature_Count; ++first) {
+    for (int second = first; second < LayoutFeature_Count; ++second) {
+      for (int third = second; third < LayoutFeature_Count; ++third) {
+        LayoutFeatureSet combination = feature_bit(LayoutFeature(first)) |
+                                       feature_bit(LayoutFeature(second)) |
+                                       feature_bit(LayoutFeature(third));
+        if (combination_index.count(combination))
+          continue;
+        combination_index[combination] = combinations.size();
+        combinations.push_back(combination);
+      }
+    }
+  }
+  covered.resize(combinations.size(), false);
+}
+
+// Called with the mutex held.
+bool CoverageMap::add_line(const std::string &line) {
+  LayoutFeatureSet combination = 0;
+  size_t start = 0;
+  while (start <= line.size()) {
+    size_t end = line.find('+', start);
+    if (end == std::string::npos)
+      end = line.size();
+    std::string name = line.substr(start, end - start);
+    int feature = 0;
+    while (feature < LayoutFeature_Count &&
+           name != kLayoutFeatureNames[feature])
+      ++feature;
+    // Lines naming features this version does not know are skipped.
+    if (feature == LayoutFeature_Count)
+      return false;
+    combination |= feature_bit(LayoutFeature(feature));
+    start = end + 1;
+  }
+  auto index = combination_index.find(combination);
+  if (index == combination_index.end())
+    return false;
+  if (!covered[index->second]) {
+    covered[index->second] = true;
+    ++covered_count;
+  }
+  return true;
+}
+
+bool CoverageMap::load(const std::string &path) {
+  std::ifstream in(path);
+  if (!in)
+    return errno == ENOENT;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::string line;
+  while (std::getline(in, line))
+    add_line(line);
+  return true;
+}
+
+bool CoverageMap::save(const std::string &path) {
+  // Merge in what other campaigns saved since this one loaded the map.
+  if (!load(path))
+    return false;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::string temp_path = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream out(temp_path);
+    for (size_t index = 0; index < combinations.size(); ++index) {
+      if (!covered[index])
+        continue;
+      const char *separator = "";
+      for (int feature = 0; feature < LayoutFeature_Count; ++feature) {
+        if (combinations[index] & feature_bit(LayoutFeature(feature))) {
+          out << separator << kLayoutFeatureNames[feature];
+          separator = "+";
+        }
+      }
+      out << '\n';
+    }
+    if (!out)
+      return false;
+  }
+  return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+void CoverageMap::record(LayoutFeatureSet features) {
+  std::vector<LayoutFeature> present;
+  for (int feature = 0; feature < LayoutFeature_Count; ++feature) {
+    if (features & feature_bit(LayoutFeature(feature)))
+      present.push_back(LayoutFeature(feature));
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  auto cover = [this](LayoutFeatureSet combination) {
+    int index = combination_index[combination];
+    if (!covered[index]) {
+      covered[index] = true;
+      ++covered_count;
+    }
+  };
+  for (size_t first = 0; first < present.size(); ++first) {
+    cover(feature_bit(present[first]));
+    for (size_t second = first + 1; second < present.size(); ++second) {
+      cover(feature_bit(present[first]) | feature_bit(present[second]));
+      for (size_t third = second + 1; third < present.size(); ++third)
+        cover(feature_bit(present[first]) | feature_bit(present[second]) |
+              feature_bit(present[third]));
+    }
+  }
+}
+
+LayoutFeatureSet CoverageMap::pick_uncovered(RandomStream &random) {
+  std::lock_guard<std::mutex> lock(mutex);
+  int num = combinations.size();
+  if (covered_count == num)
+    return 0;
+  std::uniform_int_distribution<int> index_dist(0, num - 1);
+  int index = index_dist(random);
+  // Walking on from a random start favors combinations that follow long runs
+  // of covered ones, but only once coverage is high enough for random picks
+  // to keep missing.
+  for (int attempt = 0; attempt < 32 && covered[index]; ++attempt)
+    index = index_dist(random);
+  while (covered[index])
+    index = (index + 1) % num;
+  return combinations[index];
+}
+
+int CoverageMap::num_covered() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return covered_count;
+}
@@ -0,0 +1,149 @@
+#include "dedup.h"
+
+#include <cerrno>
+#include <fstream>
+
+#include "type.h"
+
+namespace {
+
+// Folds values into a 64-bit hash with the splitmix64 finalizer, so that
+// small inputs still change every bit.
+class LayoutHashBuilder {
+ public:
+  LayoutHashBuilder() : state(0) {}
+
+  void add(uint64_t value) {
+    uint64_t x = state ^ value;
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    state = x ^ (x >> 31);
+  }
+
+  uint64_t get() const { return state; }
+
+ private:
+  uint64_t state;
+};
+
+// Tags that keep the parts of a class apart in the hash.
+enum LayoutTag {
+  LayoutTag_Class = 1,
+  LayoutTag_Base,
+  LayoutTag_Field,
+  LayoutTag_Method,
+  LayoutTag_ClassRef,
+};
+
+}  // namespace
+
+uint64_t hash_class_layout(const GenerationContext &context, int class_i) {
+  // Classes are numbered in the order a breadth-first walk from `class_i`
+  // reaches them, and referred to by that number, so the hash captures which
+  // references lead to the same class without depending on class indices.
+  std::vector<int> number(class_i + 1, -1);
+  std::vector<int> queue(1, class_i);
+  number[class_i] = 0;
+  LayoutHashBuilder hash;
+  auto add_class_ref = [&](int target) {
+    if (number[target] == -1) {
+      number[target] = queue.size();
+      queue.push_back(target);
+    }
+    hash.add(LayoutTag_ClassRef);
+    hash.add(number[target]);
+  };
+
+  for (size_t queue_i = 0; queue_i < queue.size(); ++queue_i) {
+    const Class &type = *context.types[queue[queue_i]];
+    hash.add(LayoutTag_Class);
+    hash.add(uint64_t(type.alignment));
+    hash.add(uint64_t(type.packed));
+    hash.add(uint64_t(type.vtordisp));
+    hash.add(type.gnu_alignment_spelling | type.has_ctor << 1 |
+             type.has_dllexport << 2);
+
+    for (int base : type.direct_bases) {
+      hash.add(LayoutTag_Base);
+      hash.add(type.is_direct_vbase(base));
+      add_class_ref(base);
+    }
+
+    for (const Class::Field &field : type.fields) {
+      hash.add(LayoutTag_Field);
+      hash.add(field.type);
+      hash.add(uint64_t(field.bitfield_width));
+      hash.add(uint64_t(field.alignment));
+      hash.add(field.is_anonymous | field.gnu_alignment_spelling << 1);
+      hash.add(field.array_dimensions.size());
+      for (int dimension : field.array_dimensions)
+        hash.add(dimension);
+      // Where a pointer to a class points does not change its size, but the
+      // representation of member pointers can depend on their class.
+      if (field.type > TypeKind_PClass)
+        add_class_ref(field.type_class);
+    }
+
+    for (const Class::Method &method : type.methods) {
+      hash.add(LayoutTag_Method);
+      hash.add(method.is_virtual | method.is_pure << 1 |
+               (method.name_class == -1) << 2);
+      // Whether a method overrides one of a base, which makes it virtual and
+      // can give the base a vtordisp, depends on its parameter type.
+      hash.add(canonical_parameter_kind(method.arg_type));
+      if (method.arg_type >= TypeKind_PClass)
+        add_class_ref(method.arg_type_class);
+    }
+  }
+  return hash.get();
+}
+
+void update_layout_hashes(GenerationContext &context) {
+  while (context.layout_hashes.size() < context.types.size())
+    context.layout_hashes.push_back(
+        hash_class_layout(context, context.layout_hashes.size()));
+}
+
+bool LayoutIndex::load(const std::string &index_path) {
+  path = index_path;
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return errno == ENOENT;
+  unsigned char bytes[8];
+  while (in.read(reinterpret_cast<char *>(bytes), sizeof(bytes))) {
+    uint64_t hash = 0;
+    for (int byte_i = 7; byte_i >= 0; --byte_i)
+      hash = hash << 8 | bytes[byte_i];
+    hashes.insert(hash);
+  }
+  // A torn final record from an interrupted save is ignored.
+  return in.eof();
+}
+
+void LayoutIndex::select_untested(const GenerationContext &context,
+                                  std::vector<int> &test_order) {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t kept = 0;
+  for (int class_i : test_order) {
+    uint64_t hash = context.layout_hashes[class_i];
+    if (!hashes.insert(hash).second)
+      continue;
+    added.push_back(hash);
+    test_order[kept++] = class_i;
+  }
+  test_order.resize(kept);
+}
+
+bool LayoutIndex::save() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::ofstream out(path, std::ios::binary | std::ios::app);
+  for (uint64_t hash : added) {
+    unsigned char bytes[8];
+    for (int byte_i = 0; byte_i < 8; ++byte_i)
+      bytes[byte_i] = hash >> (8 * byte_i);
+    out.write(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+  }
+  added.clear();
+  return bool(out);
+}
@@ -0,0 +1,619 @@
+// Runs a differential testing campaign: generates a program per seed,
+// compiles it with two compilers, runs both executables and compares the
+// offsets, sizes and alignments they print.  Programs that the compilers
+// disagree on are copied to the results directory.  With --cache, what a
+// compiler did with a program it has seen before is looked up instead of
+// compiled and run again.  With --arms, each seed is generated with one of
+// several sets of extra generator arguments, chosen to favor the sets that
+// find new kinds of mismatches fastest.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "captured_layout.h"
+#include "option.h"
+#include "process.h"
+#include "result_cache.h"
+#include "scheduler.h"
+
+static Option<std::string> seed_range("seed-range");
+static Option<std::string> compiler_a("compiler-a", "g++");
+static Option<std::string> compiler_b("compiler-b", "clang++");
+// Defaults to the superfuzz next to this executable.
+static Option<std::string> generator("generator");
+static Option<std::string> generator_args("generator-args", "--gnu-dialect");
+static Option<std::string> work_dir("work-dir", "difftest-work");
+static Option<std::string> results_dir("results-dir", "difftest-results");
+static Option<int> jobs("jobs", 0);
+static Option<bool> keep_files("keep-files", false);
+// A cache of compile and run results shared by every campaign that uses it.
+static Option<std::string> cache_path("cache");
+// A file of arms, one line of extra generator arguments each, to spread the
+// seeds over.
+static Option<std::string> arms_path("arms");
+// Log every choice of arm and what it cost and found to this file.
+static Option<std::string> schedule_log("schedule-log");
+// Choose the arms a schedule log chose, for the seeds it covers.
+static Option<std::string> replay_path("replay");
+static Option<unsigned long> scheduler_seed("scheduler-seed", 1);
+static Option<bool> show_help("help", false);
+
+// The lines both executables must agree on: field offsets, sizeof and
+// alignof.
+static bool read_layout_lines(const std::string &path,
+                              std::vector<std::string> &lines) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.find(" : ") != std::string::npos ||
+        line.find("sizeof(") != std::string::npos ||
+        line.find("alignof") != std::string::npos)
+      lines.push_back(line);
+  }
+  return true;
+}
+
+static void append_file(std::ostream &out, const std::string &path) {
+  std::ifstream in(path);
+  if (in)
+    out << in.rdbuf();
+}
+
+static std::string read_file(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::string contents;
+  if (in)
+    contents.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+  return contents;
+}
+
+static bool write_file(const std::string &path, const std::string &contents) {
+  std::ofstream out(path, std::ios::binary);
+  out << contents;
+  return bool(out);
+}
+
+// What tells one kind of mismatch from another: its kind and description,
+// plus the first error for a compile failure, with numbers left out so that
+// class names, offsets and line numbers do not matter.
+static std::string mismatch_signature(const std::string &kind,
+                                      const std::string &details,
+                                      const std::string &log_path) {
+  std::string text = kind + '\n' + details;
+  if (!log_path.empty()) {
+    std::ifstream log(log_path);
+    std::string line;
+    while (std::getline(log, line)) {
+      if (line.find("error") != std::string::npos) {
+        text += line;
+        break;
+      }
+    }
+  }
+  std::string signature;
+  for (char c : text) {
+    if (!isdigit((unsigned char)c))
+      signature += c;
+    else if (signature.empty() || signature.back() != '#')
+      signature += '#';
+  }
+  return signature;
+}
+
+class Campaign {
+ public:
+  // `cache` may be null; otherwise `compiler_identity` tells apart the
+  // compilers results are cached for.  `scheduler` may be null.
+  Campaign(const std::string &generator_path, unsigned long first_seed,
+           unsigned long last_seed, int num_jobs, ResultCache *cache,
+           const std::string compiler_identity[2], ArmScheduler *scheduler)
+      : generator_path(generator_path),
+        next_seed(first_seed),
+        last_seed(last_seed),
+        num_jobs(num_jobs),
+        seeds_exhausted(false),
+        cache(cache),
+        compiler_identity{compiler_identity[0], compiler_identity[1]},
+        scheduler(scheduler),
+        in_flight(0),
+        failed(false),
+        num_compared(0),
+        num_invalid(0),
+        num_failed_alike(0),
+        num_out_of_memory(0),
+        num_mismatches(0),
+        num_cached(0) {}
+
+  bool run();
+
+ private:
+  // Every seed goes through these stages in order.  Compiling and running
+  // happen once per compiler, in parallel.
+  enum Stage {
+    Stage_Generate,
+    Stage_Compile,
+    Stage_Run,
+    Stage_Compare,
+  };
+
+  struct Task {
+    Stage stage;
+    unsigned long seed;
+    int variant;
+  };
+
+  // Later stages go first so that seeds already started finish, and free
+  // their files, before new ones are generated.
+  struct TaskOrder {
+    bool operator()(const Task &lhs, const Task &rhs) const {
+      if (lhs.stage != rhs.stage)
+        return lhs.stage < rhs.stage;
+      return lhs.seed > rhs.seed;
+    }
+  };
+
+  struct SeedState {
+    // Tasks of the current stage that have not finished.
+    int pending;
+    int compile_status[2];
+    int run_status[2];
+    // Keys into the cache, empty without one.
+    std::string cache_key[2];
+    // Whether the result came from the cache, so there is nothing to run.
+    bool cached[2];
+    // The arm the seed was generated with, or -1 without a scheduler.
+    int arm;
+    // Time spent on the seed's tasks so far.
+    double seconds;
+  };
+
+  std::string path(unsigned long seed, const char *suffix) const {
+    return std::string(work_dir) + '/' + std::to_string(seed) + suffix;
+  }
+
+  void worker();
+  void execute(const Task &task);
+  void start_next_seed();
+  void finish_seed(unsigned long seed);
+  // Returns how many new distinct mismatches the seed found.
+  int compare(unsigned long seed, const SeedState &state);
+  std::string generator_arguments(const SeedState &state) const;
+  void record(unsigned long seed, const std::string &arguments,
+              const std::string &kind, const std::string &details,
+              const std::string &log_path);
+
+  std::string generator_path;
+  unsigned long next_seed;
+  unsigned long last_seed;
+  int num_jobs;
+  bool seeds_exhausted;
+  ResultCache *cache;
+  std::string compiler_identity[2];
+  ArmScheduler *scheduler;
+
+  std::mutex mutex;
+  std::condition_variable task_ready;
+  std::priority_queue<Task, std::vector<Task>, TaskOrder> tasks;
+  std::map<unsigned long, SeedState> seeds;
+  std::set<std::string> signatures;
+  int in_flight;
+  bool failed;
+  unsigned long num_compared;
+  unsigned long num_invalid;
+  // Programs that both executables failed on with the same status, such as
+  // a crash of the generated code itself.
+  unsigned long num_failed_alike;
+  // Programs that either executable stopped testing for lack of memory,
+  // with the same layouts up to there.
+  unsigned long num_out_of_memory;
+  unsigned long num_mismatches;
+  unsigned long num_cached;
+};
+
+bool Campaign::run() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Keep enough seeds in flight that every worker has something to do
+    // while others wait on a compiler.
+    for (int job_i = 0; job_i < 2 * num_jobs; ++job_i)
+      start_next_seed();
+  }
+
+  std::vector<std::thread> workers;
+  for (int job_i = 0; job_i < num_jobs; ++job_i)
+    workers.emplace_back(&Campaign::worker, this);
+  for (auto &thread : workers)
+    thread.join();
+
+  std::cout << "compared " << num_compared << " programs: " << num_mismatches
+            << " mismatches (" << signatures.size() << " distinct), "
+            << num_invalid << " rejected by both compilers, "
+            << num_failed_alike << " failed alike under both, "
+            << num_out_of_memory << " ran out of memory\n";
+  if (scheduler)
+    scheduler->print_summary(std::cout);
+  if (cache)
+    std::cout << num_cached << " of " << 2 * num_compared
+              << " compiles served from the cache\n";
+  return !failed;
+}
+
+// Called with the mutex held.
+void Campaign::start_next_seed() {
+  if (failed || seeds_exhausted)
+    return;
+  unsigned long seed = next_seed;
+  if (seed == last_seed)
+    seeds_exhausted = true;
+  else
+    ++next_seed;
+  SeedState &state = seeds[seed];
+  state.pending = 1;
+  state.arm = scheduler ? scheduler->choose(seed) : -1;
+  state.seconds = 0;
+  ++in_flight;
+  tasks.push(Task{Stage_Generate, seed, 0});
+}
+
+void Campaign::worker() {
+  for (;;) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      task_ready.wait(lock,
+                      [this] { return !tasks.empty() || in_flight == 0; });
+      if (tasks.empty())
+        return;
+      task = tasks.top();
+      tasks.pop();
+    }
+    execute(task);
+  }
+}
+
+void Campaign::execute(const Task &task) {
+  unsigned long seed = task.seed;
+  const char *variant_suffix = task.variant == 0 ? ".a" : ".b";
+  std::string source = path(seed, ".cpp");
+  std::string binary = path(seed, variant_suffix);
+  std::string cache_key;
+  bool cached = false;
+  int cached_run_status = 0;
+  std::string arguments;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const SeedState &state = seeds[seed];
+    if (task.stage == Stage_Generate)
+      arguments = generator_arguments(state);
+    if (cache && (task.stage == Stage_Compile || task.stage == Stage_Run)) {
+      cache_key = state.cache_key[task.variant];
+      cached = state.cached[task.variant];
+      cached_run_status = state.run_status[task.variant];
+    }
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+  int status = 0;
+  std::string new_cache_keys[2];
+  switch (task.stage) {
+    case Stage_Generate:
+      status = run_command(shell_quote(generator_path) + " --seed=" +
+                           std::to_string(seed) + ' ' + arguments + " > " +
+                           shell_quote(source));
+      if (status == 0 && cache) {
+        std::string program = read_file(source);
+        for (int variant = 0; variant < 2; ++variant)
+          new_cache_keys[variant] =
+              content_hash({program, compiler_identity[variant]});
+      }
+      break;
+    case Stage_Compile: {
+      CachedResult result;
+      if (cache && cache->lookup(cache_key, result)) {
+        write_file(binary + (result.compile_status == 0 ? ".out" : ".log"),
+                   result.output);
+        status = result.compile_status;
+        cached = true;
+        cached_run_status = result.run_status;
+        break;
+      }
+      status = run_command(
+          std::string(task.variant == 0 ? compiler_a : compiler_b) + " -o " +
+          shell_quote(binary) + ' ' + shell_quote(source) + " > " +
+          shell_quote(binary + ".log") + " 2>&1");
+      if (status != 0 && cache)
+        cache->store(cache_key,
+                     CachedResult{status, -1, read_file(binary + ".log")});
+      break;
+    }
+    case Stage_Run:
+      if (cached) {
+        status = cached_run_status;
+        break;
+      }
+      status = run_command(shell_quote(binary) + " > " +
+                           shell_quote(binary + ".out") + " 2>&1");
+      if (cache)
+        cache->store(cache_key,
+                     CachedResult{0, status, read_file(binary + ".out")});
+      break;
+    case Stage_Compare:
+      break;
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  SeedState &state = seeds[seed];
+  state.seconds += elapsed.count();
+  switch (task.stage) {
+    case Stage_Generate:
+      if (status != 0) {
+        std::cerr << "could not generate a program for seed " << seed << '\n';
+        failed = true;
+        finish_seed(seed);
+        return;
+      }
+      state.pending = 2;
+      state.cache_key[0] = new_cache_keys[0];
+      state.cache_key[1] = new_cache_keys[1];
+      tasks.push(Task{Stage_Compile, seed, 0});
+      tasks.push(Task{Stage_Compile, seed, 1});
+      task_ready.notify_all();
+      return;
+    case Stage_Compile:
+      state.compile_status[task.variant] = status;
+      if (cached) {
+        state.cached[task.variant] = true;
+        state.run_status[task.variant] = cached_run_status;
+        ++num_cached;
+      }
+      if (--state.pending != 0)
+        return;
+      if (state.compile_status[0] == 0 && state.compile_status[1] == 0) {
+        state.pending = 2;
+        tasks.push(Task{Stage_Run, seed, 0});
+        tasks.push(Task{Stage_Run, seed, 1});
+      } else {
+        tasks.push(Task{Stage_Compare, seed, 0});
+      }
+      task_ready.notify_all();
+      return;
+    case Stage_Run:
+      state.run_status[task.variant] = status;
+      if (--state.pending != 0)
+        return;
+      tasks.push(Task{Stage_Compare, seed, 0});
+      task_ready.notify_one();
+      return;
+    case Stage_Compare: {
+      SeedState finished = state;
+      lock.unlock();
+      int num_new = compare(seed, finished);
+      lock.lock();
+      if (scheduler)
+        scheduler->report(seed, finished.arm, finished.seconds, num_new);
+      finish_seed(seed);
+      return;
+    }
+  }
+}
+
+// Called with the mutex held.
+void Campaign::finish_seed(unsigned long seed) {
+  seeds.erase(seed);
+  --in_flight;
+  start_next_seed();
+  task_ready.notify_all();
+}
+
+// Called with the mutex held.
+std::string Campaign::generator_arguments(const SeedState &state) const {
+  std::string arguments = generator_args;
+  if (state.arm >= 0)
+    arguments += ' ' + scheduler->arm_arguments(state.arm);
+  return arguments;
+}
+
+int Campaign::compare(unsigned long seed, const SeedState &state) {
+  bool compiled_a = state.compile_status[0] == 0;
+  bool compiled_b = state.compile_status[1] == 0;
+  std::string kind;
+  std::string details;
+  std::string log_path;
+  // Running out of memory excuses a program, but not a failure of the other.
+  const int *run_status = state.run_status;
+  bool out_of_memory =
+      (run_status[0] == kOutOfMemoryStatus ||
+       run_status[1] == kOutOfMemoryStatus) &&
+      (run_status[0] == 0 || run_status[0] == kOutOfMemoryStatus) &&
+      (run_status[1] == 0 || run_status[1] == kOutOfMemoryStatus);
+  if (!compiled_a && !compiled_b) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++num_invalid;
+  } else if (!compiled_a || !compiled_b) {
+    kind = "compile-failure";
+    details = std::string(compiled_a ? compiler_b : compiler_a) +
+              " rejected the program:\n";
+    log_path = path(seed, compiled_a ? ".b.log" : ".a.log");
+  } else if (!out_of_memory && state.run_status[0] != 0 &&
+             state.run_status[0] == state.run_status[1]) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++num_failed_alike;
+  } else if (!out_of_memory &&
+             (state.run_status[0] != 0 || state.run_status[1] != 0)) {
+    kind = "run-failure";
+    details = "exit status " + std::to_string(state.run_status[0]) + " vs " +
+              std::to_string(state.run_status[1]) + '\n';
+  } else {
+    std::vector<std::string> lines_a, lines_b;
+    read_layout_lines(path(seed, ".a.out"), lines_a);
+    read_layout_lines(path(seed, ".b.out"), lines_b);
+    // A program out of memory stopped before its next test, so only the
+    // tests both programs finished are compared.
+    if (out_of_memory) {
+      size_t num_finished = std::min(lines_a.size(), lines_b.size());
+      lines_a.resize(num_finished);
+      lines_b.resize(num_finished);
+    }
+    size_t line_i = 0;
+    while (line_i < lines_a.size() && line_i < lines_b.size() &&
+           lines_a[line_i] == lines_b[line_i])
+      ++line_i;
+    if (line_i != lines_a.size() || line_i != lines_b.size()) {
+      kind = "layout";
+      details = "first difference at layout line " +
+                std::to_string(line_i + 1) + ":\n";
+      details += "  " + std::string(compiler_a) + ": " +
+                 (line_i < lines_a.size() ? lines_a[line_i] : "<end>") + '\n';
+      details += "  " + std::string(compiler_b) + ": " +
+                 (line_i < lines_b.size() ? lines_b[line_i] : "<end>") + '\n';
+    } else if (out_of_memory) {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++num_out_of_memory;
+    }
+  }
+
+  int num_new = 0;
+  if (!kind.empty()) {
+    std::string signature = mismatch_signature(kind, details, log_path);
+    std::string arguments;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      num_new = signatures.insert(signature).second;
+      arguments = generator_arguments(state);
+    }
+    record(seed, arguments, kind, details, log_path);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++num_compared;
+  }
+
+  if (!keep_files) {
+    for (const char *suffix : {".cpp", ".a", ".b", ".a.log", ".b.log",
+                               ".a.out", ".b.out"})
+      std::remove(path(seed, suffix).c_str());
+  }
+  return num_new;
+}
+
+void Campaign::record(unsigned long seed, const std::string &arguments,
+                      const std::string &kind, const std::string &details,
+                      const std::string &log_path) {
+  std::string prefix = std::string(results_dir) + '/' + std::to_string(seed);
+  {
+    std::ofstream program(prefix + ".cpp");
+    append_file(program, path(seed, ".cpp"));
+  }
+  {
+    std::ofstream report(prefix + ".txt");
+    report << "seed: " << seed << '\n';
+    report << "kind: " << kind << '\n';
+    report << "generator arguments: " << arguments << '\n';
+    report << details;
+    if (!log_path.empty())
+      append_file(report, log_path);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  ++num_mismatches;
+  std::ofstream summary(std::string(results_dir) + "/mismatches.txt",
+                        std::ios::app);
+  summary << seed << ' ' << kind << '\n';
+}
+
+int main(int argc, const char *argv[]) {
+  parse_options(argc, argv);
+
+  if (show_help) {
+    usage(argv[0]);
+    return EXIT_SUCCESS;
+  }
+
+  unsigned long first_seed, last_seed;
+  if (!parse_seed_range(seed_range, first_seed, last_seed)) {
+    std::cerr << argv[0] << ": --seed-range=first:last is required\n";
+    return EXIT_FAILURE;
+  }
+
+  std::string generator_path = generator;
+  if (generator_path.empty())
+    generator_path = sibling_program(argv[0], "superfuzz");
+
+  for (const std::string &dir : {std::string(work_dir),
+                                 std::string(results_dir)}) {
+    if (!make_directory(dir)) {
+      std::cerr << argv[0] << ": could not create " << dir << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  int num_jobs = job_count(jobs);
+
+  std::unique_ptr<ResultCache> cache;
+  std::string compiler_identity[2];
+  if (!std::string(cache_path).empty()) {
+    cache.reset(new ResultCache);
+    if (!cache->open(cache_path)) {
+      std::cerr << argv[0] << ": could not open " << std::string(cache_path)
+                << '\n';
+      return EXIT_FAILURE;
+    }
+    // A compiler is identified by how it is invoked, flags included, and by
+    // what it says its version is.
+    for (int variant = 0; variant < 2; ++variant) {
+      std::string compiler = variant == 0 ? compiler_a : compiler_b;
+      std::string version_path = std::string(work_dir) + "/compiler-" +
+                                 (variant == 0 ? "a" : "b") + ".version";
+      run_command(compiler + " --version > " + shell_quote(version_path) +
+                  " 2>&1");
+      compiler_identity[variant] = compiler + '\n' + read_file(version_path);
+      std::remove(version_path.c_str());
+    }
+  }
+
+  std::unique_ptr<ArmScheduler> scheduler;
+  if (!std::string(arms_path).empty()) {
+    scheduler.reset(new ArmScheduler(scheduler_seed));
+    std::string error;
+    if (!scheduler->load_arms(arms_path, error) ||
+        (!std::string(replay_path).empty() &&
+         !scheduler->load_replay(replay_path, error))) {
+      std::cerr << argv[0] << ": " << error << '\n';
+      return EXIT_FAILURE;
+    }
+    if (!std::string(schedule_log).empty() &&
+        !scheduler->open_log(schedule_log)) {
+      std::cerr << argv[0] << ": could not write "
+                << std::string(schedule_log) << '\n';
+      return EXIT_FAILURE;
+    }
+  } else if (!std::string(schedule_log).empty() ||
+             !std::string(replay_path).empty()) {
+    std::cerr << argv[0] << ": --schedule-log and --replay need --arms\n";
+    return EXIT_FAILURE;
+  }
+
+  Campaign campaign(generator_path, first_seed, last_seed, num_jobs,
+                    cache.get(), compiler_identity, scheduler.get());
+  return campaign.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
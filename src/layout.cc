@@ -0,0 +1,1356 @@
+#include "layout.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <utility>
+
+// The two builders below follow Clang's ItaniumRecordLayoutBuilder and
+// MicrosoftRecordLayoutBuilder for an x86-64 target, restricted to the
+// constructs superfuzz can generate.  Note that the fields the generator
+// calls TypeKind_PMF are declared as `int (C::*name)`, which is a pointer to
+// data member, so they are laid out like TypeKind_PDM.  Their array
+// dimensions end up inside the parentheses and describe the pointee.
+
+static long long align_to(long long value, long long alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool contains(const std::vector<int> &values, int value) {
+  return std::find(values.begin(), values.end(), value) != values.end();
+}
+
+static bool is_dynamic(const ClassFacts &facts) {
+  return facts.is_polymorphic || facts.has_vbases();
+}
+
+static bool has_extendable_vfptr(const ClassLayout &layout) {
+  return layout.has_own_vfptr || layout.primary_base != -1;
+}
+
+static long long get_num_array_elements(const Class::Field &field) {
+  if (field.type == TypeKind_PMF)
+    return 1;
+  long long num_elements = 1;
+  for (int dim : field.array_dimensions)
+    num_elements *= dim;
+  return num_elements;
+}
+
+const ClassLayout::VBase *ClassLayout::find_vbase(int class_i) const {
+  for (auto &vbase : vbases)
+    if (vbase.class_i == class_i)
+      return &vbase;
+  return nullptr;
+}
+
+namespace {
+
+class ItaniumLayoutBuilder {
+ public:
+  ItaniumLayoutBuilder(const GenerationContext &context,
+                       const LayoutEngine &engine, const Class &type)
+      : context(context),
+        engine(engine),
+        type(type),
+        facts(engine.get_facts(type.class_i)),
+        size(0),
+        data_size(0),
+        unfilled_bits_in_last_unit(0),
+        alignment(1),
+        max_field_alignment(type.packed > -1 ? type.packed : 0),
+        first_nearly_empty_vbase(-1),
+        max_empty_class_offset(0) {}
+
+  ClassLayout layout();
+
+ private:
+  bool is_nearly_empty(int class_i) const;
+
+  void update_alignment(long long new_alignment) {
+    alignment = std::max(alignment, new_alignment);
+  }
+
+  // A base subobject of the class being laid out, see Clang's
+  // BaseSubobjectInfo.  Every virtual base has a single one.
+  struct BaseSubobject {
+    int class_i;
+    bool is_virtual;
+    // Indexed like the direct bases of the class.
+    std::vector<BaseSubobject *> bases;
+    // The primary virtual base of the class, if this subobject claimed it.
+    // Only the claiming subobject places it, at its own offset.
+    BaseSubobject *primary_virtual_base;
+    // The subobject that claimed this virtual base, if any.
+    BaseSubobject *derived;
+  };
+
+  void compute_base_subobjects();
+  BaseSubobject *compute_base_subobject(int class_i, bool is_virtual);
+  bool claims_primary_virtual_base(const BaseSubobject &base) const {
+    return base.primary_virtual_base &&
+           base.primary_virtual_base->derived == &base;
+  }
+
+  void add_indirect_primary_bases(int class_i, std::set<int> &visited);
+  void select_primary_vbase(int class_i, std::set<int> &visited);
+  void determine_primary_base();
+  long long layout_base(const BaseSubobject &base);
+  void layout_virtual_base(const BaseSubobject &base);
+  void add_primary_virtual_base_offsets(const BaseSubobject &base,
+                                        long long offset);
+  void layout_non_virtual_base(size_t base_i);
+  void layout_non_virtual_bases();
+  void layout_virtual_bases(int class_i, std::set<int> &visited);
+  void layout_field(const Class::Field &field);
+  void layout_bitfield(const Class::Field &field);
+  void finish_layout();
+
+  // Empty subobjects of the same type may not share an address, see
+  // Clang's EmptySubobjectMap.
+  void compute_empty_subobject_sizes();
+  bool any_empty_subobjects_beyond_offset(long long offset) const {
+    return offset <= max_empty_class_offset;
+  }
+  bool can_place_subobject_at_offset(int class_i, long long offset) const;
+  void add_subobject_at_offset(int class_i, long long offset);
+  bool can_place_base_subobject_at_offset(const BaseSubobject &base,
+                                          long long offset) const;
+  void update_empty_base_subobjects(const BaseSubobject &base,
+                                    long long offset, bool placing_empty_base);
+  bool can_place_record_field_at_offset(int class_i, int most_derived,
+                                        long long offset) const;
+  bool can_place_field_subobject_at_offset(const Class::Field &field,
+                                           long long offset) const;
+  void update_empty_record_field_subobjects(int class_i, int most_derived,
+                                            long long offset);
+  void update_empty_field_subobjects(const Class::Field &field,
+                                     long long offset);
+  bool can_place_base_at_offset(const BaseSubobject &base, long long offset);
+  bool can_place_field_at_offset(const Class::Field &field, long long offset);
+
+  const GenerationContext &context;
+  const LayoutEngine &engine;
+  const Class &type;
+  const ClassFacts &facts;
+  ClassLayout result;
+
+  // Size and data size are tracked in bits.
+  long long size;
+  long long data_size;
+  long long unfilled_bits_in_last_unit;
+  long long alignment;
+  long long max_field_alignment;
+  std::set<int> indirect_primary_bases;
+  std::set<int> visited_virtual_bases;
+  int first_nearly_empty_vbase;
+
+  std::map<long long, std::vector<int>> empty_class_offsets;
+  long long max_empty_class_offset;
+
+  std::deque<BaseSubobject> base_subobjects;
+  // Indexed like type.direct_bases.
+  std::vector<BaseSubobject *> direct_base_subobjects;
+  std::map<int, BaseSubobject *> virtual_base_subobjects;
+};
+
+void ItaniumLayoutBuilder::compute_base_subobjects() {
+  for (int base : type.direct_bases) {
+    direct_base_subobjects.push_back(
+        compute_base_subobject(base, type.is_direct_vbase(base)));
+  }
+}
+
+ItaniumLayoutBuilder::BaseSubobject *
+ItaniumLayoutBuilder::compute_base_subobject(int class_i, bool is_virtual) {
+  if (is_virtual) {
+    auto existing = virtual_base_subobjects.find(class_i);
+    if (existing != virtual_base_subobjects.end())
+      return existing->second;
+  }
+  base_subobjects.push_back(
+      BaseSubobject{class_i, is_virtual, {}, nullptr, nullptr});
+  BaseSubobject *subobject = &base_subobjects.back();
+  if (is_virtual)
+    virtual_base_subobjects[class_i] = subobject;
+
+  // A primary virtual base goes to the first subobject in inheritance graph
+  // order that has it as its primary base.  If it has been seen already, it
+  // is claimed here unless taken; if not, it is claimed after the bases,
+  // from any of them that claimed it.
+  const ClassLayout &layout = engine.get_layout(class_i);
+  bool claim_after_bases = false;
+  if (layout.primary_base_is_virtual) {
+    auto primary = virtual_base_subobjects.find(layout.primary_base);
+    if (primary == virtual_base_subobjects.end()) {
+      claim_after_bases = true;
+    } else if (!primary->second->derived) {
+      subobject->primary_virtual_base = primary->second;
+      primary->second->derived = subobject;
+    }
+  }
+
+  const Class &record = *context.types[class_i];
+  for (int base : record.direct_bases) {
+    subobject->bases.push_back(
+        compute_base_subobject(base, record.is_direct_vbase(base)));
+  }
+
+  if (claim_after_bases) {
+    BaseSubobject *primary = virtual_base_subobjects[layout.primary_base];
+    subobject->primary_virtual_base = primary;
+    primary->derived = subobject;
+  }
+  return subobject;
+}
+
+void ItaniumLayoutBuilder::compute_empty_subobject_sizes() {
+  long long &largest = result.size_of_largest_empty_subobject;
+  for (int base : type.direct_bases) {
+    const ClassLayout &base_layout = engine.get_layout(base);
+    largest = std::max(largest, engine.get_facts(base).is_empty
+                                    ? base_layout.size
+                                    : base_layout.size_of_largest_empty_subobject);
+  }
+  for (auto &field : type.fields) {
+    if (field.type != TypeKind_Class)
+      continue;
+    const ClassLayout &field_layout = engine.get_layout(field.type_class);
+    largest = std::max(largest,
+                       engine.get_facts(field.type_class).is_empty
+                           ? field_layout.size
+                           : field_layout.size_of_largest_empty_subobject);
+  }
+}
+
+bool ItaniumLayoutBuilder::can_place_subobject_at_offset(
+    int class_i, long long offset) const {
+  if (!engine.get_facts(class_i).is_empty)
+    return true;
+  auto classes = empty_class_offsets.find(offset);
+  return classes == empty_class_offsets.end() ||
+         !contains(classes->second, class_i);
+}
+
+void ItaniumLayoutBuilder::add_subobject_at_offset(int class_i,
+                                                   long long offset) {
+  if (!engine.get_facts(class_i).is_empty)
+    return;
+  std::vector<int> &classes = empty_class_offsets[offset];
+  if (contains(classes, class_i))
+    return;
+  classes.push_back(class_i);
+  max_empty_class_offset = std::max(max_empty_class_offset, offset);
+}
+
+bool ItaniumLayoutBuilder::can_place_base_subobject_at_offset(
+    const BaseSubobject &base, long long offset) const {
+  if (!any_empty_subobjects_beyond_offset(offset))
+    return true;
+  if (!can_place_subobject_at_offset(base.class_i, offset))
+    return false;
+
+  const Class &base_type = *context.types[base.class_i];
+  const ClassLayout &base_layout = engine.get_layout(base.class_i);
+  for (size_t base_i = 0; base_i < base.bases.size(); ++base_i) {
+    if (base.bases[base_i]->is_virtual)
+      continue;
+    if (!can_place_base_subobject_at_offset(
+            *base.bases[base_i], offset + base_layout.base_offsets[base_i]))
+      return false;
+  }
+  if (claims_primary_virtual_base(base) &&
+      !can_place_base_subobject_at_offset(*base.primary_virtual_base, offset))
+    return false;
+
+  for (size_t field_i = 0; field_i < base_type.fields.size(); ++field_i) {
+    const Class::Field &field = base_type.fields[field_i];
+    if (field.bitfield_width > -1)
+      continue;
+    if (!can_place_field_subobject_at_offset(
+            field, offset + base_layout.field_offsets[field_i] / 8))
+      return false;
+  }
+  return true;
+}
+
+void ItaniumLayoutBuilder::update_empty_base_subobjects(
+    const BaseSubobject &base, long long offset, bool placing_empty_base) {
+  // Only empty bases placed at offset zero can conflict with the empty
+  // subobjects of a non-empty base.
+  if (!placing_empty_base &&
+      offset >= result.size_of_largest_empty_subobject)
+    return;
+
+  add_subobject_at_offset(base.class_i, offset);
+
+  const Class &base_type = *context.types[base.class_i];
+  const ClassLayout &base_layout = engine.get_layout(base.class_i);
+  for (size_t base_i = 0; base_i < base.bases.size(); ++base_i) {
+    if (base.bases[base_i]->is_virtual)
+      continue;
+    update_empty_base_subobjects(*base.bases[base_i],
+                                 offset + base_layout.base_offsets[base_i],
+                                 placing_empty_base);
+  }
+  if (claims_primary_virtual_base(base))
+    update_empty_base_subobjects(*base.primary_virtual_base, offset,
+                                 placing_empty_base);
+
+  for (size_t field_i = 0; field_i < base_type.fields.size(); ++field_i) {
+    const Class::Field &field = base_type.fields[field_i];
+    if (field.bitfield_width > -1)
+      continue;
+    update_empty_field_subobjects(
+        field, offset + base_layout.field_offsets[field_i] / 8);
+  }
+}
+
+bool ItaniumLayoutBuilder::can_place_record_field_at_offset(
+    int class_i, int most_derived, long long offset) const {
+  if (!any_empty_subobjects_beyond_offset(offset))
+    return true;
+  if (!can_place_subobject_at_offset(class_i, offset))
+    return false;
+
+  const Class &record = *context.types[class_i];
+  const ClassLayout &record_layout = engine.get_layout(class_i);
+  for (size_t base_i = 0; base_i < record.direct_bases.size(); ++base_i) {
+    if (record_layout.base_offsets[base_i] < 0)
+      continue;
+    if (!can_place_record_field_at_offset(
+            record.direct_bases[base_i], most_derived,
+            offset + record_layout.base_offsets[base_i]))
+      return false;
+  }
+  if (class_i == most_derived) {
+    for (auto &vbase : record_layout.vbases) {
+      if (!can_place_record_field_at_offset(vbase.class_i, most_derived,
+                                            offset + vbase.offset))
+        return false;
+    }
+  }
+
+  for (size_t field_i = 0; field_i < record.fields.size(); ++field_i) {
+    const Class::Field &field = record.fields[field_i];
+    if (field.bitfield_width > -1)
+      continue;
+    if (!can_place_field_subobject_at_offset(
+            field, offset + record_layout.field_offsets[field_i] / 8))
+      return false;
+  }
+  return true;
+}
+
+bool ItaniumLayoutBuilder::can_place_field_subobject_at_offset(
+    const Class::Field &field, long long offset) const {
+  if (!any_empty_subobjects_beyond_offset(offset))
+    return true;
+  if (field.type != TypeKind_Class)
+    return true;
+
+  long long element_size = engine.get_layout(field.type_class).size;
+  long long num_elements = get_num_array_elements(field);
+  long long element_offset = offset;
+  for (long long element_i = 0; element_i < num_elements; ++element_i) {
+    if (!any_empty_subobjects_beyond_offset(element_offset))
+      return true;
+    if (!can_place_record_field_at_offset(field.type_class, field.type_class,
+                                          element_offset))
+      return false;
+    element_offset += element_size;
+  }
+  return true;
+}
+
+void ItaniumLayoutBuilder::update_empty_record_field_subobjects(
+    int class_i, int most_derived, long long offset) {
+  // Only empty subobjects of empty bases placed at offset zero can conflict
+  // with the empty subobjects of a field.
+  if (offset >= result.size_of_largest_empty_subobject)
+    return;
+
+  add_subobject_at_offset(class_i, offset);
+
+  const Class &record = *context.types[class_i];
+  const ClassLayout &record_layout = engine.get_layout(class_i);
+  for (size_t base_i = 0; base_i < record.direct_bases.size(); ++base_i) {
+    if (record_layout.base_offsets[base_i] < 0)
+      continue;
+    update_empty_record_field_subobjects(
+        record.direct_bases[base_i], most_derived,
+        offset + record_layout.base_offsets[base_i]);
+  }
+  if (class_i == most_derived) {
+    for (auto &vbase : record_layout.vbases)
+      update_empty_record_field_subobjects(vbase.class_i, most_derived,
+                                           offset + vbase.offset);
+  }
+
+  for (size_t field_i = 0; field_i < record.fields.size(); ++field_i) {
+    const Class::Field &field = record.fields[field_i];
+    if (field.bitfield_width > -1)
+      continue;
+    update_empty_field_subobjects(
+        field, offset + record_layout.field_offsets[field_i] / 8);
+  }
+}
+
+void ItaniumLayoutBuilder::update_empty_field_subobjects(
+    const Class::Field &field, long long offset) {
+  if (field.type != TypeKind_Class)
+    return;
+
+  long long element_size = engine.get_layout(field.type_class).size;
+  long long num_elements = get_num_array_elements(field);
+  long long element_offset = offset;
+  for (long long element_i = 0; element_i < num_elements; ++element_i) {
+    if (element_offset >= result.size_of_largest_empty_subobject)
+      return;
+    update_empty_record_field_subobjects(field.type_class, field.type_class,
+                                         element_offset);
+    element_offset += element_size;
+  }
+}
+
+bool ItaniumLayoutBuilder::can_place_base_at_offset(const BaseSubobject &base,
+                                                    long long offset) {
+  if (result.size_of_largest_empty_subobject == 0)
+    return true;
+  if (!can_place_base_subobject_at_offset(base, offset))
+    return false;
+  update_empty_base_subobjects(base, offset,
+                               engine.get_facts(base.class_i).is_empty);
+  return true;
+}
+
+bool ItaniumLayoutBuilder::can_place_field_at_offset(const Class::Field &field,
+                                                     long long offset) {
+  if (!can_place_field_subobject_at_offset(field, offset))
+    return false;
+  update_empty_field_subobjects(field, offset);
+  return true;
+}
+
+void ItaniumLayoutBuilder::add_indirect_primary_bases(int class_i,
+                                                      std::set<int> &visited) {
+  if (!visited.insert(class_i).second)
+    return;
+  const ClassLayout &base_layout = engine.get_layout(class_i);
+  if (base_layout.primary_base_is_virtual)
+    indirect_primary_bases.insert(base_layout.primary_base);
+  for (int base : context.types[class_i]->direct_bases) {
+    if (engine.get_facts(base).has_vbases())
+      add_indirect_primary_bases(base, visited);
+  }
+}
+
+// GCC, unlike Clang, does not go by the size of the class: an empty base
+// aligned beyond the vptr leaves a class nearly empty.  An empty base that
+// does not fit at offset zero does not.
+bool ItaniumLayoutBuilder::is_nearly_empty(int class_i) const {
+  const ClassFacts &class_facts = engine.get_facts(class_i);
+  if (!is_dynamic(class_facts) || !class_facts.is_nearly_empty)
+    return false;
+  const Class &record = *context.types[class_i];
+  const ClassLayout &class_layout = engine.get_layout(class_i);
+  for (size_t base_i = 0; base_i < record.direct_bases.size(); ++base_i) {
+    int base = record.direct_bases[base_i];
+    if (record.is_direct_vbase(base))
+      continue;
+    if (engine.get_facts(base).is_empty ? class_layout.base_offsets[base_i] != 0
+                                        : !is_nearly_empty(base))
+      return false;
+  }
+  return true;
+}
+
+void ItaniumLayoutBuilder::select_primary_vbase(int class_i,
+                                                std::set<int> &visited) {
+  if (!visited.insert(class_i).second)
+    return;
+  const Class &record = *context.types[class_i];
+  for (int base : record.direct_bases) {
+    if (record.is_direct_vbase(base) && is_nearly_empty(base)) {
+      if (!indirect_primary_bases.count(base)) {
+        result.primary_base = base;
+        result.primary_base_is_virtual = true;
+        return;
+      }
+      if (first_nearly_empty_vbase == -1)
+        first_nearly_empty_vbase = base;
+    }
+    select_primary_vbase(base, visited);
+    if (result.primary_base != -1)
+      return;
+  }
+}
+
+void ItaniumLayoutBuilder::determine_primary_base() {
+  if (!is_dynamic(facts))
+    return;
+
+  if (facts.has_vbases()) {
+    std::set<int> visited;
+    for (int base : type.direct_bases) {
+      if (engine.get_facts(base).has_vbases())
+        add_indirect_primary_bases(base, visited);
+    }
+  }
+
+  // The primary base is the first non-virtual dynamic base...
+  for (int base : type.direct_bases) {
+    if (type.is_direct_vbase(base))
+      continue;
+    if (is_dynamic(engine.get_facts(base))) {
+      result.primary_base = base;
+      result.primary_base_is_virtual = false;
+      return;
+    }
+  }
+
+  // ...otherwise the first nearly empty virtual base that is not an indirect
+  // primary base, or failing that the first that is.
+  if (facts.has_vbases()) {
+    std::set<int> visited;
+    select_primary_vbase(type.class_i, visited);
+    if (result.primary_base != -1)
+      return;
+  }
+  if (first_nearly_empty_vbase != -1) {
+    result.primary_base = first_nearly_empty_vbase;
+    result.primary_base_is_virtual = true;
+  }
+}
+
+long long ItaniumLayoutBuilder::layout_base(const BaseSubobject &base) {
+  const ClassLayout &base_layout = engine.get_layout(base.class_i);
+  const ClassFacts &base_facts = engine.get_facts(base.class_i);
+  long long base_alignment = base_layout.nv_alignment;
+
+  // Empty bases go at offset zero if nothing of the same type is there.
+  if (base_facts.is_empty && can_place_base_at_offset(base, 0)) {
+    size = std::max(size, base_layout.size * 8);
+    update_alignment(base_alignment);
+    return 0;
+  }
+
+  // Where #pragma pack lowers the alignment of a base, this follows GCC
+  // rather than Clang, since the GNU dialect is checked against GCC.  GCC
+  // does not pack an empty base that does not fit at offset zero, which
+  // then also raises the alignment of the class.  And when a base conflicts
+  // with an empty subobject, GCC moves on by the unpacked non-virtual
+  // alignment of the class, whereas Clang moves on by the packed one.
+  if (max_field_alignment && !base_facts.is_empty)
+    base_alignment = std::min(base_alignment, max_field_alignment);
+
+  long long position = data_size / 8;
+  long long offset = align_to(position, base_alignment);
+  while (!can_place_base_at_offset(base, offset)) {
+    position += base_layout.nv_alignment;
+    offset = align_to(position, base_alignment);
+  }
+
+  if (!base_facts.is_empty) {
+    data_size = (offset + base_layout.nv_size) * 8;
+    size = std::max(size, data_size);
+  } else {
+    size = std::max(size, (offset + base_layout.size) * 8);
+  }
+  update_alignment(base_alignment);
+  return offset;
+}
+
+void ItaniumLayoutBuilder::add_primary_virtual_base_offsets(
+    const BaseSubobject &base, long long offset) {
+  if (!engine.get_facts(base.class_i).has_vbases())
+    return;
+
+  if (claims_primary_virtual_base(base)) {
+    result.vbases.push_back(ClassLayout::VBase{
+        base.primary_virtual_base->class_i, offset, false});
+    add_primary_virtual_base_offsets(*base.primary_virtual_base, offset);
+  }
+
+  const ClassLayout &base_layout = engine.get_layout(base.class_i);
+  for (size_t base_i = 0; base_i < base.bases.size(); ++base_i) {
+    if (base.bases[base_i]->is_virtual)
+      continue;
+    add_primary_virtual_base_offsets(*base.bases[base_i],
+                                     offset + base_layout.base_offsets[base_i]);
+  }
+}
+
+void ItaniumLayoutBuilder::layout_virtual_base(const BaseSubobject &base) {
+  long long offset = layout_base(base);
+  result.vbases.push_back(ClassLayout::VBase{base.class_i, offset, false});
+  add_primary_virtual_base_offsets(base, offset);
+}
+
+void ItaniumLayoutBuilder::layout_non_virtual_base(size_t base_i) {
+  const BaseSubobject &base = *direct_base_subobjects[base_i];
+  result.base_offsets[base_i] = layout_base(base);
+  add_primary_virtual_base_offsets(base, result.base_offsets[base_i]);
+}
+
+void ItaniumLayoutBuilder::layout_non_virtual_bases() {
+  determine_primary_base();
+
+  if (result.primary_base != -1) {
+    if (result.primary_base_is_virtual) {
+      // This class takes the base over from any base that claimed it.
+      BaseSubobject &primary = *virtual_base_subobjects[result.primary_base];
+      primary.derived = nullptr;
+      indirect_primary_bases.insert(result.primary_base);
+      visited_virtual_bases.insert(result.primary_base);
+      layout_virtual_base(primary);
+    } else {
+      size_t primary_base_i = std::find(type.direct_bases.begin(),
+                                        type.direct_bases.end(),
+                                        result.primary_base) -
+                              type.direct_bases.begin();
+      layout_non_virtual_base(primary_base_i);
+    }
+  } else if (is_dynamic(facts)) {
+    long long vptr_alignment = 8;
+    if (max_field_alignment)
+      vptr_alignment = std::min(vptr_alignment, max_field_alignment);
+    size = align_to(size, vptr_alignment * 8);
+    update_alignment(vptr_alignment);
+    size += 64;
+    data_size = size;
+  }
+
+  for (size_t base_i = 0; base_i < type.direct_bases.size(); ++base_i) {
+    int base = type.direct_bases[base_i];
+    if (type.is_direct_vbase(base))
+      continue;
+    if (base == result.primary_base && !result.primary_base_is_virtual)
+      continue;
+    layout_non_virtual_base(base_i);
+  }
+}
+
+void ItaniumLayoutBuilder::layout_virtual_bases(int class_i,
+                                                std::set<int> &visited) {
+  // Walking a class again cannot lay out anything new.
+  if (!visited.insert(class_i).second)
+    return;
+
+  const Class &record = *context.types[class_i];
+  int primary_base = result.primary_base;
+  bool primary_base_is_virtual = result.primary_base_is_virtual;
+  if (class_i != type.class_i) {
+    primary_base = engine.get_layout(class_i).primary_base;
+    primary_base_is_virtual =
+        engine.get_layout(class_i).primary_base_is_virtual;
+  }
+
+  for (int base : record.direct_bases) {
+    if (record.is_direct_vbase(base) &&
+        (primary_base != base || !primary_base_is_virtual) &&
+        !indirect_primary_bases.count(base) &&
+        visited_virtual_bases.insert(base).second) {
+      layout_virtual_base(*virtual_base_subobjects[base]);
+    }
+    if (engine.get_facts(base).has_vbases())
+      layout_virtual_bases(base, visited);
+  }
+}
+
+void ItaniumLayoutBuilder::layout_field(const Class::Field &field) {
+  if (field.bitfield_width > -1) {
+    layout_bitfield(field);
+    return;
+  }
+
+  unfilled_bits_in_last_unit = 0;
+
+  long long field_size, type_alignment;
+  engine.get_field_type_info(field, field_size, type_alignment);
+  long long field_alignment = type_alignment;
+  if (field.alignment > -1)
+    field_alignment = std::max<long long>(field_alignment, field.alignment);
+  if (max_field_alignment)
+    field_alignment = std::min(field_alignment, max_field_alignment);
+
+  // Like a base, a field that conflicts with an empty subobject moves on by
+  // the unpacked alignment of its type in GCC.
+  long long position = data_size / 8;
+  long long field_offset = align_to(position, field_alignment);
+  while (!can_place_field_at_offset(field, field_offset)) {
+    position += type_alignment;
+    field_offset = align_to(position, field_alignment);
+  }
+
+  result.field_offsets.push_back(field_offset * 8);
+  data_size = (field_offset + field_size) * 8;
+  size = std::max(size, data_size);
+  update_alignment(field_alignment);
+}
+
+void ItaniumLayoutBuilder::layout_bitfield(const Class::Field &field) {
+  long long width = field.bitfield_width;
+  long long type_size, type_alignment;
+  engine.get_field_type_info(field, type_size, type_alignment);
+  long long storage_unit_size = type_size * 8;
+  long long field_alignment = type_alignment * 8;
+  long long unpacked_field_alignment = field_alignment;
+
+  long long field_offset = data_size - unfilled_bits_in_last_unit;
+
+  long long explicit_alignment = field.alignment > -1 ? field.alignment * 8 : 0;
+  if (explicit_alignment) {
+    field_alignment = std::max(field_alignment, explicit_alignment);
+    unpacked_field_alignment =
+        std::max(unpacked_field_alignment, explicit_alignment);
+  }
+  long long max_field_alignment_bits = max_field_alignment * 8;
+  if (max_field_alignment && width) {
+    unpacked_field_alignment =
+        std::min(unpacked_field_alignment, max_field_alignment_bits);
+    field_alignment = std::min(field_alignment, max_field_alignment_bits);
+  }
+
+  // #pragma pack, with any value, suppresses the insertion of padding.
+  bool allow_padding = max_field_alignment == 0;
+  if (width == 0 ||
+      (allow_padding &&
+       (field_offset & (field_alignment - 1)) + width > storage_unit_size)) {
+    field_offset = align_to(field_offset, field_alignment);
+  } else if (explicit_alignment) {
+    // GCC honors an aligned attribute up to the #pragma pack limit.
+    if (max_field_alignment)
+      explicit_alignment =
+          std::min(explicit_alignment, max_field_alignment_bits);
+    field_offset = align_to(field_offset, explicit_alignment);
+  }
+
+  result.field_offsets.push_back(field_offset);
+
+  // Unnamed bitfields do not affect the alignment of the record.
+  if (field.is_anonymous)
+    field_alignment = unpacked_field_alignment = 8;
+
+  long long new_size = field_offset + width;
+  data_size = align_to(new_size, 8);
+  unfilled_bits_in_last_unit = data_size - new_size;
+  size = std::max(size, data_size);
+  update_alignment(field_alignment / 8);
+}
+
+void ItaniumLayoutBuilder::finish_layout() {
+  if (size == 0 && facts.is_empty)
+    size = 8;
+  size = align_to(size, alignment * 8);
+}
+
+ClassLayout ItaniumLayoutBuilder::layout() {
+  if (type.alignment > -1)
+    update_alignment(type.alignment);
+  result.base_offsets.assign(type.direct_bases.size(), -1);
+  compute_base_subobjects();
+  compute_empty_subobject_sizes();
+
+  layout_non_virtual_bases();
+  for (auto &field : type.fields)
+    layout_field(field);
+
+  long long nv_size = align_to(size, 8) / 8;
+  result.nv_alignment = alignment;
+
+  std::set<int> visited;
+  layout_virtual_bases(type.class_i, visited);
+  finish_layout();
+
+  result.size = size / 8;
+  result.alignment = alignment;
+  // The tail padding of a POD can never be reused.
+  result.data_size = facts.is_pod ? result.size : data_size / 8;
+  result.nv_size = facts.is_pod ? result.size : nv_size;
+  return result;
+}
+
+class MicrosoftLayoutBuilder {
+ public:
+  MicrosoftLayoutBuilder(const GenerationContext &context,
+                         const LayoutEngine &engine, const Class &type)
+      : context(context),
+        engine(engine),
+        type(type),
+        facts(engine.get_facts(type.class_i)),
+        size(0),
+        alignment(1),
+        // In 64-bit mode there is always an alignment step at the end.
+        required_alignment(1),
+        max_field_alignment(0),
+        pointer_alignment(8),
+        has_vbptr(false),
+        shared_vbptr_base(-1),
+        vbptr_offset(0),
+        last_field_is_non_zero_width_bitfield(false),
+        current_bitfield_size(0),
+        remaining_bits_in_field(0) {
+    // The Microsoft ABI ignores #pragma pack larger than the pointer size.
+    if (type.packed > -1 && type.packed <= 8)
+      max_field_alignment = type.packed;
+    if (max_field_alignment)
+      pointer_alignment = std::min(pointer_alignment, max_field_alignment);
+  }
+
+  ClassLayout layout();
+
+ private:
+  long long get_adjusted_base_alignment(const ClassLayout &base_layout);
+  long long get_adjusted_field_alignment(const Class::Field &field,
+                                         long long field_alignment);
+  void layout_non_virtual_base(size_t base_i,
+                               const ClassLayout *&previous_base_layout);
+  void layout_non_virtual_bases();
+  void layout_field(const Class::Field &field);
+  void layout_bitfield(const Class::Field &field);
+  void layout_zero_width_bitfield(const Class::Field &field);
+  void inject_vbptr();
+  void inject_vfptr();
+  void compute_vtordisp_set(std::set<int> &has_vtordisp_set) const;
+  bool requires_vtordisp(const std::vector<int> &bases_with_overridden_methods,
+                         int class_i) const;
+  void layout_virtual_bases();
+  void finalize_layout();
+
+  const GenerationContext &context;
+  const LayoutEngine &engine;
+  const Class &type;
+  const ClassFacts &facts;
+  ClassLayout result;
+
+  long long size;
+  long long alignment;
+  long long required_alignment;
+  long long max_field_alignment;
+  long long pointer_alignment;
+  bool has_vbptr;
+  int shared_vbptr_base;
+  long long vbptr_offset;
+  bool last_field_is_non_zero_width_bitfield;
+  long long current_bitfield_size;
+  long long remaining_bits_in_field;
+};
+
+long long MicrosoftLayoutBuilder::get_adjusted_base_alignment(
+    const ClassLayout &base_layout) {
+  long long base_alignment = base_layout.alignment;
+  if (max_field_alignment)
+    base_alignment = std::min(base_alignment, max_field_alignment);
+  result.ends_with_zero_sized_object = base_layout.ends_with_zero_sized_object;
+  // The required alignment is not subject to #pragma pack, and it does not
+  // contribute to the alignment of the record until it is finalized.
+  alignment = std::max(alignment, base_alignment);
+  required_alignment =
+      std::max(required_alignment, base_layout.required_alignment);
+  return std::max(base_alignment, base_layout.required_alignment);
+}
+
+long long MicrosoftLayoutBuilder::get_adjusted_field_alignment(
+    const Class::Field &field, long long field_alignment) {
+  long long field_required_alignment = std::max(field.alignment, 0);
+  if (field.type == TypeKind_Class &&
+      context.types[field.type_class]->alignment > -1) {
+    field_required_alignment =
+        std::max(field_required_alignment,
+                 engine.get_layout(field.type_class).alignment);
+  }
+  if (field.bitfield_width > -1) {
+    // __declspec(align) on a bitfield affects its alignment rather than the
+    // required alignment of the record.
+    field_alignment = std::max(field_alignment, field_required_alignment);
+  } else {
+    if (field.type == TypeKind_Class) {
+      const ClassLayout &field_layout = engine.get_layout(field.type_class);
+      result.ends_with_zero_sized_object =
+          field_layout.ends_with_zero_sized_object;
+      field_required_alignment = std::max(field_required_alignment,
+                                          field_layout.required_alignment);
+    }
+    required_alignment =
+        std::max(required_alignment, field_required_alignment);
+  }
+  if (max_field_alignment)
+    field_alignment = std::min(field_alignment, max_field_alignment);
+  return std::max(field_alignment, field_required_alignment);
+}
+
+void MicrosoftLayoutBuilder::layout_non_virtual_base(
+    size_t base_i, const ClassLayout *&previous_base_layout) {
+  const ClassLayout &base_layout =
+      engine.get_layout(type.direct_bases[base_i]);
+  // Zero sized subobjects of the same class may not share an address.
+  if (previous_base_layout &&
+      previous_base_layout->ends_with_zero_sized_object &&
+      base_layout.leads_with_zero_sized_base)
+    ++size;
+  long long base_alignment = get_adjusted_base_alignment(base_layout);
+  size = align_to(size, base_alignment);
+  result.base_offsets[base_i] = size;
+  size += base_layout.nv_size;
+  result.data_size = size;
+  previous_base_layout = &base_layout;
+}
+
+void MicrosoftLayoutBuilder::layout_non_virtual_bases() {
+  const ClassLayout *previous_base_layout = nullptr;
+  bool has_polymorphic_base = false;
+
+  // Bases with a vfptr that can be extended are laid out first.
+  for (size_t base_i = 0; base_i < type.direct_bases.size(); ++base_i) {
+    int base = type.direct_bases[base_i];
+    has_polymorphic_base |= engine.get_facts(base).is_polymorphic;
+    if (type.is_direct_vbase(base)) {
+      has_vbptr = true;
+      continue;
+    }
+    const ClassLayout &base_layout = engine.get_layout(base);
+    if (shared_vbptr_base == -1 && base_layout.vbptr_offset != -1) {
+      shared_vbptr_base = base;
+      has_vbptr = true;
+    }
+    if (!has_extendable_vfptr(base_layout))
+      continue;
+    if (result.primary_base == -1) {
+      result.primary_base = base;
+      result.leads_with_zero_sized_base =
+          base_layout.leads_with_zero_sized_base;
+    }
+    layout_non_virtual_base(base_i, previous_base_layout);
+  }
+
+  if (facts.is_polymorphic) {
+    if (!has_polymorphic_base) {
+      result.has_own_vfptr = true;
+    } else if (result.primary_base == -1) {
+      // No vftable to extend: only add a vfptr if we need new slots.
+      for (size_t method_i = 0; method_i < type.methods.size(); ++method_i) {
+        if (facts.method_is_virtual[method_i] &&
+            !facts.method_overrides[method_i]) {
+          result.has_own_vfptr = true;
+          break;
+        }
+      }
+    }
+  }
+
+  bool check_leading_layout = result.primary_base == -1;
+  for (size_t base_i = 0; base_i < type.direct_bases.size(); ++base_i) {
+    int base = type.direct_bases[base_i];
+    if (type.is_direct_vbase(base))
+      continue;
+    const ClassLayout &base_layout = engine.get_layout(base);
+    if (has_extendable_vfptr(base_layout)) {
+      vbptr_offset = result.base_offsets[base_i] + base_layout.nv_size;
+      continue;
+    }
+    if (check_leading_layout) {
+      check_leading_layout = false;
+      result.leads_with_zero_sized_base =
+          base_layout.leads_with_zero_sized_base;
+    }
+    layout_non_virtual_base(base_i, previous_base_layout);
+    vbptr_offset = result.base_offsets[base_i] + base_layout.nv_size;
+  }
+
+  if (!has_vbptr) {
+    vbptr_offset = -1;
+  } else if (shared_vbptr_base != -1) {
+    auto shared_pos = std::find(type.direct_bases.begin(),
+                                type.direct_bases.end(), shared_vbptr_base);
+    vbptr_offset = result.base_offsets[shared_pos - type.direct_bases.begin()] +
+                   engine.get_layout(shared_vbptr_base).vbptr_offset;
+  }
+}
+
+void MicrosoftLayoutBuilder::layout_field(const Class::Field &field) {
+  if (field.bitfield_width > 0) {
+    layout_bitfield(field);
+    return;
+  }
+  if (field.bitfield_width == 0) {
+    layout_zero_width_bitfield(field);
+    return;
+  }
+
+  last_field_is_non_zero_width_bitfield = false;
+  long long field_size, field_alignment;
+  engine.get_field_type_info(field, field_size, field_alignment);
+  field_alignment = get_adjusted_field_alignment(field, field_alignment);
+  alignment = std::max(alignment, field_alignment);
+
+  long long field_offset = align_to(size, field_alignment);
+  result.field_offsets.push_back(field_offset * 8);
+  result.data_size = std::max(result.data_size, field_offset + field_size);
+  size = std::max(size, field_offset + field_size);
+}
+
+void MicrosoftLayoutBuilder::layout_bitfield(const Class::Field &field) {
+  long long width = field.bitfield_width;
+  long long field_size, field_alignment;
+  engine.get_field_type_info(field, field_size, field_alignment);
+  field_alignment = get_adjusted_field_alignment(field, field_alignment);
+  width = std::min(width, field_size * 8);
+
+  // Bitfields only share storage with bitfields of the same type size.
+  if (last_field_is_non_zero_width_bitfield &&
+      current_bitfield_size == field_size &&
+      width <= remaining_bits_in_field) {
+    result.field_offsets.push_back(size * 8 - remaining_bits_in_field);
+    remaining_bits_in_field -= width;
+    return;
+  }
+
+  last_field_is_non_zero_width_bitfield = true;
+  current_bitfield_size = field_size;
+  long long field_offset = align_to(size, field_alignment);
+  result.field_offsets.push_back(field_offset * 8);
+  size = field_offset + field_size;
+  alignment = std::max(alignment, field_alignment);
+  remaining_bits_in_field = field_size * 8 - width;
+  result.data_size = size;
+}
+
+void MicrosoftLayoutBuilder::layout_zero_width_bitfield(
+    const Class::Field &field) {
+  // Zero-width bitfields are ignored unless they follow a bitfield.
+  if (!last_field_is_non_zero_width_bitfield) {
+    result.field_offsets.push_back(size * 8);
+    return;
+  }
+
+  last_field_is_non_zero_width_bitfield = false;
+  long long field_size, field_alignment;
+  engine.get_field_type_info(field, field_size, field_alignment);
+  field_alignment = get_adjusted_field_alignment(field, field_alignment);
+  long long field_offset = align_to(size, field_alignment);
+  result.field_offsets.push_back(field_offset * 8);
+  size = field_offset;
+  alignment = std::max(alignment, field_alignment);
+  result.data_size = size;
+}
+
+void MicrosoftLayoutBuilder::inject_vbptr() {
+  if (!has_vbptr || shared_vbptr_base != -1)
+    return;
+
+  long long injection_site = vbptr_offset;
+  vbptr_offset = align_to(vbptr_offset, pointer_alignment);
+  long long field_start = vbptr_offset + 8;
+  long long offset = align_to(field_start - injection_site,
+                              std::max(required_alignment, alignment));
+  size += offset;
+  for (auto &field_offset : result.field_offsets)
+    field_offset += offset * 8;
+  for (auto &base_offset : result.base_offsets) {
+    if (base_offset >= injection_site)
+      base_offset += offset;
+  }
+}
+
+void MicrosoftLayoutBuilder::inject_vfptr() {
+  if (!result.has_own_vfptr)
+    return;
+
+  long long offset = align_to(8, std::max(required_alignment, alignment));
+  if (has_vbptr)
+    vbptr_offset += offset;
+  size += offset;
+  for (auto &field_offset : result.field_offsets)
+    field_offset += offset * 8;
+  for (auto &base_offset : result.base_offsets) {
+    if (base_offset >= 0)
+      base_offset += offset;
+  }
+}
+
+bool MicrosoftLayoutBuilder::requires_vtordisp(
+    const std::vector<int> &bases_with_overridden_methods, int class_i) const {
+  if (contains(bases_with_overridden_methods, class_i))
+    return true;
+  const Class &record = *context.types[class_i];
+  for (int base : record.direct_bases) {
+    if (!record.is_direct_vbase(base) &&
+        requires_vtordisp(bases_with_overridden_methods, base))
+      return true;
+  }
+  return false;
+}
+
+void MicrosoftLayoutBuilder::compute_vtordisp_set(
+    std::set<int> &has_vtordisp_set) const {
+  // #pragma vtordisp(1) is the default.
+  int vtordisp_mode = type.vtordisp > -1 ? type.vtordisp : 1;
+
+  if (vtordisp_mode == 2) {
+    for (int vbase : facts.vbases) {
+      if (has_extendable_vfptr(engine.get_layout(vbase)))
+        has_vtordisp_set.insert(vbase);
+    }
+    return;
+  }
+
+  // If any of our bases need a vtordisp for a virtual base, so do we.
+  for (int base : type.direct_bases) {
+    for (auto &vbase : engine.get_layout(base).vbases) {
+      if (vbase.has_vtordisp)
+        has_vtordisp_set.insert(vbase.class_i);
+    }
+  }
+
+  if (!type.has_ctor || vtordisp_mode == 0)
+    return;
+
+  // Virtual bases that declare a method we override, or contain such a base
+  // as a non-virtual base, need a vtordisp.
+  for (int vbase : facts.vbases) {
+    if (!has_vtordisp_set.count(vbase) &&
+        requires_vtordisp(facts.bases_with_overridden_methods, vbase))
+      has_vtordisp_set.insert(vbase);
+  }
+}
+
+void MicrosoftLayoutBuilder::layout_virtual_bases() {
+  if (!has_vbptr)
+    return;
+
+  // vtordisps are always 4 bytes, even in 64-bit mode.
+  long long vtordisp_size = 4;
+  long long vtordisp_alignment = vtordisp_size;
+  if (max_field_alignment)
+    vtordisp_alignment = std::min(vtordisp_alignment, max_field_alignment);
+  for (int vbase : facts.vbases) {
+    required_alignment = std::max(
+        required_alignment, engine.get_layout(vbase).required_alignment);
+  }
+  vtordisp_alignment = std::max(vtordisp_alignment, required_alignment);
+
+  std::set<int> has_vtordisp_set;
+  compute_vtordisp_set(has_vtordisp_set);
+
+  const ClassLayout *previous_base_layout = nullptr;
+  for (int vbase : facts.vbases) {
+    const ClassLayout &base_layout = engine.get_layout(vbase);
+    bool has_vtordisp = has_vtordisp_set.count(vbase) != 0;
+    if ((previous_base_layout &&
+         previous_base_layout->ends_with_zero_sized_object &&
+         base_layout.leads_with_zero_sized_base) ||
+        has_vtordisp) {
+      size = align_to(size, vtordisp_alignment) + vtordisp_size;
+      alignment = std::max(alignment, vtordisp_alignment);
+    }
+    long long base_alignment = get_adjusted_base_alignment(base_layout);
+    long long base_offset = align_to(size, base_alignment);
+    result.vbases.push_back(
+        ClassLayout::VBase{vbase, base_offset, has_vtordisp});
+    size = base_offset + base_layout.nv_size;
+    previous_base_layout = &base_layout;
+  }
+}
+
+void MicrosoftLayoutBuilder::finalize_layout() {
+  alignment = std::max(alignment, required_alignment);
+  long long rounding_alignment = alignment;
+  if (max_field_alignment)
+    rounding_alignment = std::min(rounding_alignment, max_field_alignment);
+  rounding_alignment = std::max(rounding_alignment, required_alignment);
+  size = align_to(size, rounding_alignment);
+
+  if (size == 0) {
+    result.ends_with_zero_sized_object = true;
+    result.leads_with_zero_sized_base = true;
+    // Empty records are as large as their alignment.
+    size = alignment;
+  }
+}
+
+ClassLayout MicrosoftLayoutBuilder::layout() {
+  result.base_offsets.assign(type.direct_bases.size(), -1);
+
+  layout_non_virtual_bases();
+  for (auto &field : type.fields)
+    layout_field(field);
+  inject_vbptr();
+  inject_vfptr();
+
+  if (result.has_own_vfptr || (has_vbptr && shared_vbptr_base == -1))
+    alignment = std::max(alignment, pointer_alignment);
+  long long rounding_alignment = alignment;
+  if (max_field_alignment)
+    rounding_alignment = std::min(rounding_alignment, max_field_alignment);
+  size = align_to(size, rounding_alignment);
+  result.nv_size = size;
+  if (type.alignment > -1)
+    required_alignment =
+        std::max<long long>(required_alignment, type.alignment);
+
+  layout_virtual_bases();
+  finalize_layout();
+
+  result.size = size;
+  result.alignment = alignment;
+  result.nv_alignment = alignment;
+  result.required_alignment = required_alignment;
+  result.vbptr_offset = has_vbptr ? vbptr_offset : -1;
+  return result;
+}
+
+}  // namespace
+
+// Finds the declarations of the method named after `name_class` that are
+// visible from `class_i`: the nearest declaration along each inheritance path.
+static void lookup_method(const GenerationContext &context, int class_i,
+                          int name_class, std::set<int> &visited,
+                          std::vector<std::pair<int, int>> &found) {
+  if (!visited.insert(class_i).second)
+    return;
+  const Class &record = *context.types[class_i];
+  for (size_t method_i = 0; method_i < record.methods.size(); ++method_i) {
+    if (record.methods[method_i].name_class == name_class) {
+      found.push_back(std::make_pair(class_i, (int)method_i));
+      return;
+    }
+  }
+  for (int base : record.direct_bases)
+    lookup_method(context, base, name_class, visited, found);
+}
+
+static bool same_parameter_type(const Class::Method &lhs,
+                                const Class::Method &rhs) {
+  if (canonical_parameter_kind(lhs.arg_type) !=
+      canonical_parameter_kind(rhs.arg_type))
+    return false;
+  return lhs.arg_type < TypeKind_PClass ||
+         lhs.arg_type_class == rhs.arg_type_class;
+}
+
+LayoutEngine::LayoutEngine(const GenerationContext &context, LayoutABI abi)
+    : context(context), abi(abi) {
+  facts.reserve(context.types.size());
+  layouts.reserve(context.types.size());
+  for (Class *type : context.types) {
+    compute_facts(*type);
+    if (abi == LayoutABI_Itanium)
+      layouts.push_back(ItaniumLayoutBuilder(context, *this, *type).layout());
+    else
+      layouts.push_back(
+          MicrosoftLayoutBuilder(context, *this, *type).layout());
+  }
+}
+
+void LayoutEngine::compute_facts(const Class &type) {
+  ClassFacts info;
+  info.is_polymorphic = false;
+  info.is_empty = true;
+  // PODs in the C++03 sense, which is what the Itanium ABI uses.
+  info.is_pod = !type.has_ctor && type.direct_bases.empty();
+  info.is_nearly_empty = true;
+
+  bool seen_nearly_empty_base = false;
+  for (int base : type.direct_bases) {
+    const ClassFacts &base_facts = facts[base];
+    if (!type.is_direct_vbase(base) && !base_facts.is_empty) {
+      if (!is_dynamic(base_facts) || !base_facts.is_nearly_empty ||
+          seen_nearly_empty_base)
+        info.is_nearly_empty = false;
+      seen_nearly_empty_base = true;
+    }
+    for (int vbase : base_facts.vbases) {
+      if (!contains(info.vbases, vbase))
+        info.vbases.push_back(vbase);
+    }
+    if (type.is_direct_vbase(base) && !contains(info.vbases, base))
+      info.vbases.push_back(base);
+    info.is_polymorphic |= base_facts.is_polymorphic;
+    info.is_empty &= base_facts.is_empty;
+  }
+
+  for (auto &method : type.methods) {
+    std::vector<std::pair<int, int>> found;
+    std::set<int> visited;
+    for (int base : type.direct_bases)
+      lookup_method(context, base, method.name_class, visited, found);
+
+    std::vector<int> introducers;
+    for (auto &decl : found) {
+      const ClassFacts &decl_facts = facts[decl.first];
+      const Class::Method &decl_method =
+          context.types[decl.first]->methods[decl.second];
+      if (!decl_facts.method_is_virtual[decl.second] ||
+          !same_parameter_type(method, decl_method))
+        continue;
+      for (int introducer : decl_facts.method_introducers[decl.second]) {
+        if (!contains(introducers, introducer))
+          introducers.push_back(introducer);
+      }
+    }
+
+    bool overrides = !introducers.empty();
+    info.method_is_virtual.push_back(method.is_virtual || overrides);
+    info.method_overrides.push_back(overrides);
+    info.is_polymorphic |= info.method_is_virtual.back();
+    if (!overrides)
+      introducers.push_back(type.class_i);
+    info.method_introducers.push_back(introducers);
+  }
+
+  for (size_t method_i = 0; method_i < type.methods.size(); ++method_i) {
+    if (!info.method_is_virtual[method_i] || type.methods[method_i].is_pure)
+      continue;
+    for (int introducer : info.method_introducers[method_i]) {
+      if (!contains(info.bases_with_overridden_methods, introducer))
+        info.bases_with_overridden_methods.push_back(introducer);
+    }
+  }
+
+  for (auto &field : type.fields) {
+    if (field.bitfield_width != 0) {
+      info.is_empty = false;
+      info.is_nearly_empty = false;
+    }
+    if (field.type == TypeKind_Class && !facts[field.type_class].is_pod)
+      info.is_pod = false;
+  }
+  if (is_dynamic(info)) {
+    info.is_empty = false;
+    info.is_pod = false;
+  }
+
+  facts.push_back(info);
+}
+
+void LayoutEngine::get_field_type_info(const Class::Field &field,
+                                       long long &size,
+                                       long long &alignment) const {
+  switch (field.type) {
+    case TypeKind_Bool:     size = alignment = 1; break;
+    case TypeKind_Char:     size = alignment = 1; break;
+    case TypeKind_Short:    size = alignment = 2; break;
+    case TypeKind_Int:      size = alignment = 4; break;
+    case TypeKind_LongLong: size = alignment = 8; break;
+    case TypeKind_Float:    size = alignment = 4; break;
+    case TypeKind_Double:   size = alignment = 8; break;
+    case TypeKind_PClass:   size = alignment = 8; break;
+    case TypeKind_PMF:
+    case TypeKind_PDM:
+      if (abi == LayoutABI_Itanium) {
+        size = alignment = 8;
+      } else {
+        // An offset, plus a vbtable index for the virtual inheritance model.
+        alignment = 4;
+        size = facts[field.type_class].has_vbases() ? 8 : 4;
+      }
+      break;
+    case TypeKind_Class:
+      size = layouts[field.type_class].size;
+      alignment = layouts[field.type_class].alignment;
+      break;
+  }
+  size *= get_num_array_elements(field);
+}
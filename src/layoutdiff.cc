@@ -0,0 +1,377 @@
+// Compares what the programs of two runs printed, seed by seed: the field
+// offsets, sizes and alignments of every class they tested.  Reports the
+// first line on which each seed's outputs disagree, then groups the seeds
+// into buckets by what disagreed and by the layout features of the class it
+// is about, so that one compiler bug shows up as one bucket rather than as
+// thousands of seeds.  An offset is about the class under test, which the
+// sizeof line after its offsets names, and about the disagreeing field,
+// which that class may have inherited; the field's features count in place
+// of those of the class's own fields.
+// The features come from the snapshots superfuzz wrote for the seeds with
+// --snapshot; without them only what disagreed is used.  A seed whose
+// program ran out of memory in either run is compared up to there.
+//
+// Each run is a directory of <seed><suffix> files, for example the .a.out
+// and .b.out files difftest --keep-files leaves in its work directory.  Like
+// diff, exits with status 1 if any seed's outputs disagree and 2 on trouble,
+// such as a missing option or a run it cannot read.
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "captured_layout.h"
+#include "context.h"
+#include "coverage.h"
+#include "mapped_file.h"
+#include "option.h"
+#include "snapshot.h"
+
+static Option<std::string> run_a("run-a");
+static Option<std::string> run_b("run-b");
+static Option<std::string> suffix_a("suffix-a", ".out");
+static Option<std::string> suffix_b("suffix-b", ".out");
+// A directory of <seed>.snap files describing the programs of both runs.
+static Option<std::string> snapshot_dir("snapshots");
+static Option<int> jobs("jobs", 0);
+// List at most this many seeds for each bucket.
+static Option<int> max_examples("max-examples", 5);
+static Option<bool> show_help("help", false);
+
+// The exit status for errors, which is 1 for diverging seeds.
+static const int kTroubleStatus = 2;
+
+// Where a seed's outputs first disagree.
+struct Divergence {
+  bool found;
+  // What disagreed, such as "sizeof" or "missing output".
+  std::string what;
+  // The class under test when the lines disagreed, and for an offset the
+  // field, named after the class that declares it.
+  std::string class_name;
+  std::string field_name;
+  std::string details;
+  // The bucket of the seed: `what` and the layout features behind it.
+  std::string bucket;
+  // Whether a run stopped for lack of memory, with the same layouts as the
+  // other up to there.
+  bool out_of_memory;
+
+  Divergence() : found(false), out_of_memory(false) {}
+};
+
+// Walks the layout lines of a mapped output, skipping every other line.
+// The output ends early where the program ran out of memory.
+class LayoutLineReader {
+ public:
+  explicit LayoutLineReader(const MappedFile &file)
+      : ptr(reinterpret_cast<const char *>(file.begin())),
+        end(reinterpret_cast<const char *>(file.end())),
+        out_of_memory(false) {}
+
+  bool next(LayoutLine &line) {
+    while (ptr != end) {
+      const char *line_end =
+          static_cast<const char *>(memchr(ptr, '\n', end - ptr));
+      if (!line_end)
+        line_end = end;
+      const char *line_begin = ptr;
+      ptr = line_end == end ? end : line_end + 1;
+      if (parse_layout_line(line_begin, line_end, line))
+        return true;
+      size_t marker_length = sizeof(kOutOfMemoryLine) - 1;
+      if (size_t(line_end - line_begin) >= marker_length &&
+          memcmp(line_begin, kOutOfMemoryLine, marker_length) == 0) {
+        out_of_memory = true;
+        ptr = end;
+      }
+    }
+    return false;
+  }
+
+  bool ran_out_of_memory() const { return out_of_memory; }
+
+ private:
+  const char *ptr;
+  const char *end;
+  bool out_of_memory;
+};
+
+static std::string line_name(const LayoutLine &line) {
+  return std::string(line.name, line.name_length);
+}
+
+static std::string describe(const LayoutLine &line) {
+  switch (line.kind) {
+  case LayoutLine_FieldOffset:
+    return line_name(line) + " : " + std::to_string(line.value);
+  case LayoutLine_Size:
+    return "sizeof(" + line_name(line) + "): " + std::to_string(line.value);
+  case LayoutLine_Alignment:
+    return "alignof(" + line_name(line) + "): " + std::to_string(line.value);
+  }
+  return std::string();
+}
+
+// Fills in the class and field a line is about.  The offsets of a class
+// come before its size, so `rest`, the lines after `line`, name the class
+// under test for an offset.
+static void locate(const LayoutLine &line, LayoutLineReader rest,
+                   Divergence &divergence) {
+  std::string name = line_name(line);
+  if (line.kind != LayoutLine_FieldOffset) {
+    divergence.class_name = name;
+    return;
+  }
+  divergence.field_name = name;
+  LayoutLine next;
+  while (rest.next(next)) {
+    if (next.kind == LayoutLine_Size) {
+      divergence.class_name = line_name(next);
+      return;
+    }
+  }
+  // A run that stopped early still has the class that declares the field.
+  divergence.class_name = name.substr(0, name.find("FieldName"));
+}
+
+static bool compare_outputs(const MappedFile &a, const MappedFile &b,
+                            Divergence &divergence) {
+  // Outputs that are byte for byte the same need no parsing.
+  if (a.size() == b.size() &&
+      (a.size() == 0 || memcmp(a.begin(), b.begin(), a.size()) == 0))
+    return false;
+  LayoutLineReader reader_a(a), reader_b(b);
+  LayoutLine line_a, line_b;
+  for (;;) {
+    bool has_a = reader_a.next(line_a);
+    bool has_b = reader_b.next(line_b);
+    if ((!has_a && reader_a.ran_out_of_memory()) ||
+        (!has_b && reader_b.ran_out_of_memory())) {
+      divergence.out_of_memory = true;
+      return false;
+    }
+    if (!has_a && !has_b)
+      return false;
+    if (!has_a || !has_b) {
+      const LayoutLine &extra = has_a ? line_a : line_b;
+      divergence.what = has_a ? "run b ends early" : "run a ends early";
+      divergence.details = "next: " + describe(extra);
+      locate(extra, has_a ? reader_a : reader_b, divergence);
+      return true;
+    }
+    if (line_a.kind != line_b.kind ||
+        line_a.name_length != line_b.name_length ||
+        memcmp(line_a.name, line_b.name, line_a.name_length) != 0) {
+      divergence.what = "different lines";
+      divergence.details = describe(line_a) + " vs " + describe(line_b);
+      locate(line_a, reader_a, divergence);
+      return true;
+    }
+    if (line_a.value != line_b.value) {
+      static const char *const kKindNames[] = {"offset", "sizeof", "alignof"};
+      divergence.what = kKindNames[line_a.kind];
+      divergence.details = std::to_string(line_a.value) + " vs " +
+                           std::to_string(line_b.value);
+      locate(line_a, reader_a, divergence);
+      return true;
+    }
+  }
+}
+
+// Parses the number after `prefix` at the start of `name`, or returns -1.
+static long name_index(const std::string &name, const char *prefix) {
+  size_t prefix_length = strlen(prefix);
+  if (name.compare(0, prefix_length, prefix) != 0)
+    return -1;
+  const char *digits = name.c_str() + prefix_length;
+  if (*digits < '0' || *digits > '9')
+    return -1;
+  return strtol(digits, nullptr, 10);
+}
+
+// Names the layout features behind `divergence` in the program of `seed`,
+// or says why they are not known.
+static std::string divergence_features(unsigned long seed,
+                                       const Divergence &divergence) {
+  if (std::string(snapshot_dir).empty())
+    return "no snapshot";
+  GenerationContext context(0);
+  std::vector<int> test_order;
+  SnapshotInfo info;
+  std::string error;
+  if (!read_snapshot(std::string(snapshot_dir) + '/' + std::to_string(seed) +
+                         ".snap",
+                     context, test_order, info, error))
+    return "no snapshot";
+  long class_i = name_index(divergence.class_name, "ClassName");
+  if (class_i < 0 || size_t(class_i) >= context.types.size())
+    return "unknown class";
+  LayoutFeatureSet features = class_layout_features(*context.types[class_i]);
+  if (!divergence.field_name.empty()) {
+    const std::string &field_name = divergence.field_name;
+    size_t field_pos = field_name.find("FieldName");
+    long field_class_i = name_index(field_name, "ClassName");
+    if (field_pos == std::string::npos || field_class_i < 0 ||
+        size_t(field_class_i) >= context.types.size())
+      return "unknown field";
+    const Class &field_class = *context.types[field_class_i];
+    long field_i = name_index(field_name.substr(field_pos), "FieldName");
+    if (field_i < 0 || size_t(field_i) >= field_class.fields.size())
+      return "unknown field";
+    features = (features & ~kFieldLayoutFeatures) |
+               field_layout_features(field_class.fields[field_i]);
+  }
+  std::string names;
+  for (int feature = 0; feature < LayoutFeature_Count; ++feature) {
+    if (!(features & feature_bit(LayoutFeature(feature))))
+      continue;
+    if (!names.empty())
+      names += '+';
+    names += layout_feature_name(LayoutFeature(feature));
+  }
+  return names.empty() ? "no features" : names;
+}
+
+static void compare_seed(unsigned long seed, Divergence &divergence) {
+  std::string seed_name = std::to_string(seed);
+  MappedFile a, b;
+  bool mapped_a = a.map(std::string(run_a) + '/' + seed_name +
+                        std::string(suffix_a));
+  bool mapped_b = b.map(std::string(run_b) + '/' + seed_name +
+                        std::string(suffix_b));
+  if (!mapped_a || !mapped_b) {
+    divergence.found = true;
+    divergence.what = "missing output";
+    divergence.details = mapped_a ? "run b has none" : "run a has none";
+    divergence.bucket = divergence.what;
+    return;
+  }
+  if (!compare_outputs(a, b, divergence))
+    return;
+  divergence.found = true;
+  divergence.bucket =
+      divergence.what + ": " + divergence_features(seed, divergence);
+}
+
+// The seeds run a has outputs for, in order.
+static bool list_seeds(std::vector<unsigned long> &seeds) {
+  DIR *dir = opendir(std::string(run_a).c_str());
+  if (!dir)
+    return false;
+  std::string suffix = suffix_a;
+  while (struct dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name.size() <= suffix.size() ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+      continue;
+    std::string stem = name.substr(0, name.size() - suffix.size());
+    if (stem.find_first_not_of("0123456789") == std::string::npos)
+      seeds.push_back(strtoul(stem.c_str(), nullptr, 10));
+  }
+  closedir(dir);
+  std::sort(seeds.begin(), seeds.end());
+  return true;
+}
+
+int main(int argc, const char *argv[]) {
+  parse_options(argc, argv, kTroubleStatus);
+
+  if (show_help) {
+    usage(argv[0]);
+    return EXIT_SUCCESS;
+  }
+
+  if (std::string(run_a).empty() || std::string(run_b).empty()) {
+    std::cerr << argv[0] << ": --run-a and --run-b are required\n";
+    return kTroubleStatus;
+  }
+
+  std::vector<unsigned long> seeds;
+  if (!list_seeds(seeds)) {
+    std::cerr << argv[0] << ": could not read " << std::string(run_a)
+              << '\n';
+    return kTroubleStatus;
+  }
+
+  // A run b that cannot be read would make every seed look like it diverged.
+  if (DIR *dir = opendir(std::string(run_b).c_str())) {
+    closedir(dir);
+  } else {
+    std::cerr << argv[0] << ": could not read " << std::string(run_b)
+              << '\n';
+    return kTroubleStatus;
+  }
+
+  int num_jobs = job_count(jobs);
+
+  std::vector<Divergence> divergences(seeds.size());
+  std::atomic<size_t> next_seed_i(0);
+  std::vector<std::thread> workers;
+  for (int job_i = 0; job_i < num_jobs; ++job_i) {
+    workers.emplace_back([&]() {
+      for (size_t seed_i = next_seed_i++; seed_i < seeds.size();
+           seed_i = next_seed_i++)
+        compare_seed(seeds[seed_i], divergences[seed_i]);
+    });
+  }
+  for (std::thread &worker : workers)
+    worker.join();
+
+  std::map<std::string, std::vector<unsigned long>> buckets;
+  for (size_t seed_i = 0; seed_i < seeds.size(); ++seed_i) {
+    const Divergence &divergence = divergences[seed_i];
+    if (!divergence.found)
+      continue;
+    std::cout << seeds[seed_i] << ": " << divergence.what;
+    if (!divergence.class_name.empty()) {
+      std::cout << " in " << divergence.class_name;
+      if (!divergence.field_name.empty())
+        std::cout << ", " << divergence.field_name;
+    }
+    std::cout << ": " << divergence.details << '\n';
+    buckets[divergence.bucket].push_back(seeds[seed_i]);
+  }
+
+  // Biggest buckets first.
+  std::vector<std::pair<std::string, std::vector<unsigned long>>> sorted(
+      buckets.begin(), buckets.end());
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const std::pair<std::string,
+                                      std::vector<unsigned long>> &x,
+                      const std::pair<std::string,
+                                      std::vector<unsigned long>> &y) {
+                     return x.second.size() > y.second.size();
+                   });
+  size_t num_diverging = 0;
+  for (const auto &bucket : sorted)
+    num_diverging += bucket.second.size();
+  size_t num_out_of_memory = 0;
+  for (const Divergence &divergence : divergences)
+    num_out_of_memory += divergence.out_of_memory;
+  std::cout << num_diverging << " of " << seeds.size()
+            << " seeds diverge, in " << sorted.size() << " buckets";
+  if (num_out_of_memory)
+    std::cout << "; " << num_out_of_memory
+              << " ran out of memory before any divergence";
+  std::cout << '\n';
+  for (const auto &bucket : sorted) {
+    std::cout << "  " << bucket.second.size() << "  " << bucket.first
+              << "  (seeds";
+    int num_examples = std::min<int>(max_examples, bucket.second.size());
+    for (int example = 0; example < num_examples; ++example)
+      std::cout << ' ' << bucket.second[example];
+    if (size_t(num_examples) < bucket.second.size())
+      std::cout << " ...";
+    std::cout << ")\n";
+  }
+  return num_diverging ? EXIT_FAILURE : EXIT_SUCCESS;
+}
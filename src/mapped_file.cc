@@ -0,0 +1,39 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() { unmap(); }
+
+void MappedFile::unmap() {
+  if (data)
+    munmap(data, length);
+  data = nullptr;
+  length = 0;
+}
+
+bool MappedFile::map(const std::string &path) {
+  unmap();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    return false;
+  struct stat info;
+  bool mapped = false;
+  if (fstat(fd, &info) == 0) {
+    // mmap cannot map an empty file, which is simply an empty range.
+    if (info.st_size == 0) {
+      mapped = true;
+    } else {
+      void *addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        data = addr;
+        length = info.st_size;
+        mapped = true;
+      }
+    }
+  }
+  close(fd);
+  return mapped;
+}
@@ -1,7 +1,9 @@
 #include "option.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <thread>
 
 OptionBase::~OptionBase() {}
 
@@ -10,49 +12,69 @@ std::unordered_map<std::string, OptionBase *> &get_option_map() {
   return options;
 }
 
-void parse_options(int argc, const char *argv[]) {
+bool set_option(const std::string &arg, std::string &error) {
+  if (arg.find("--") != 0) {
+    error = "expected an option, got '" + arg + "'";
+    return false;
+  }
+  size_t equal_pos = arg.find('=');
+  std::string opt_name;
+  bool option_argument_given = equal_pos != std::string::npos;
+  std::string option_argument;
+  if (option_argument_given) {
+    opt_name = arg.substr(2, equal_pos - 2);
+    option_argument = arg.substr(equal_pos + 1);
+  } else {
+    opt_name = arg.substr(2);
+  }
+  auto &options = get_option_map();
+  auto option_pair = options.find(opt_name);
+  if (option_pair == options.end()) {
+    error = "option " + opt_name + " not found.";
+    return false;
+  }
+  OptionBase *option = option_pair->second;
+  if (option->requires_argument() && !option_argument_given) {
+    error = "option " + opt_name + " requires an argument.";
+    return false;
+  }
+  try {
+    option->set_value(option_argument.c_str());
+  } catch (...) {
+    error = "option " + opt_name + " given malformed argument '" +
+            option_argument + "'";
+    return false;
+  }
+  return true;
+}
+
+void parse_options(int argc, const char *argv[], int error_status) {
   const char *program_name = argv[0];
 
   for (int i = 1; i < argc; ++i) {
     std::string arg(argv[i]);
-    if (arg.find("--") == 0) {
-      size_t equal_pos = arg.find('=');
-      std::string opt_name;
-      bool option_argument_given = equal_pos != std::string::npos;
-      std::string option_argument;
-      if (option_argument_given) {
-        opt_name = arg.substr(2, equal_pos - 2);
-        option_argument = arg.substr(equal_pos + 1);
-      } else {
-        opt_name = arg.substr(2);
-      }
-      auto options = get_option_map();
-      auto option_pair = options.find(opt_name);
-      if (option_pair == options.end()) {
-        std::cerr << program_name << ": option " << opt_name
-                  << " not found.\n";
-        std::exit(EXIT_FAILURE);
-      }
-      OptionBase *option = option_pair->second;
-      if (option->requires_argument() && !option_argument_given) {
-        std::cerr << program_name << ": option " << opt_name
-                  << " requires an argument.\n";
-        std::exit(EXIT_FAILURE);
-      }
-      try {
-        option->set_value(option_argument.c_str());
-      } catch (...) {
-        std::cerr << program_name << ": option " << opt_name
-                  << " given malformed argument '" << option_argument << "'\n";
-        std::exit(EXIT_FAILURE);
-      }
-    } else {
+    if (arg.find("--") != 0) {
       usage(program_name);
-      std::exit(EXIT_FAILURE);
+      std::exit(error_status);
+    }
+    std::string error;
+    if (!set_option(arg, error)) {
+      std::cerr << program_name << ": " << error << '\n';
+      std::exit(error_status);
     }
   }
 }
 
+void save_options() {
+  for (auto &option_pair : get_option_map())
+    option_pair.second->save();
+}
+
+void restore_options() {
+  for (auto &option_pair : get_option_map())
+    option_pair.second->restore();
+}
+
 void usage(const char *program_name) {
   std::cout << "usage: " << program_name;
   for (auto &option_pair : get_option_map()) {
@@ -64,3 +86,38 @@ void usage(const char *program_name) {
   }
   std::cout << '\n';
 }
+
+bool parse_seed_range(const std::string &range, unsigned long &first,
+                      unsigned long &last) {
+  size_t colon_pos = range.find(':');
+  if (colon_pos == std::string::npos)
+    return false;
+  try {
+    size_t pos;
+    std::string first_str = range.substr(0, colon_pos);
+    first = std::stoul(first_str, &pos);
+    if (pos != first_str.size())
+      return false;
+    std::string last_str = range.substr(colon_pos + 1);
+    last = std::stoul(last_str, &pos);
+    if (pos != last_str.size())
+      return false;
+  } catch (...) {
+    return false;
+  }
+  return first <= last;
+}
+
+std::string sibling_program(const char *program_name, const char *name) {
+  std::string self = program_name;
+  size_t slash_pos = self.rfind('/');
+  if (slash_pos == std::string::npos)
+    return name;
+  return self.substr(0, slash_pos + 1) + name;
+}
+
+int job_count(int jobs) {
+  if (jobs > 0)
+    return jobs;
+  return std::max(1u, std::thread::hardware_concurrency());
+}
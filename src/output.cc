@@ -0,0 +1,48 @@
+#include "output.h"
+
+OutputBuffer::OutputBuffer(std::ostream &out, size_t capacity)
+    : out(out),
+      buffer(new char[capacity]),
+      capacity(capacity),
+      used(0),
+      flushed(0) {}
+
+OutputBuffer::~OutputBuffer() { flush(); }
+
+void OutputBuffer::flush() {
+  if (used == 0)
+    return;
+  out.write(buffer.get(), used);
+  flushed += used;
+  used = 0;
+}
+
+void OutputBuffer::write_slow(const char *data, size_t size) {
+  flush();
+  if (size >= capacity) {
+    out.write(data, size);
+    flushed += size;
+    return;
+  }
+  memcpy(buffer.get(), data, size);
+  used = size;
+}
+
+OutputBuffer &OutputBuffer::operator<<(unsigned long long value) {
+  char digits[20];
+  char *end = digits + sizeof(digits);
+  char *begin = end;
+  do {
+    *--begin = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  write(begin, end - begin);
+  return *this;
+}
+
+OutputBuffer &OutputBuffer::operator<<(long long value) {
+  if (value >= 0)
+    return *this << (unsigned long long)value;
+  put('-');
+  return *this << (0ULL - (unsigned long long)value);
+}
@@ -0,0 +1,112 @@
+#include "process.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+int run_command(const std::string &command) {
+  const char *argv[] = {"sh", "-c", command.c_str(), nullptr};
+  pid_t pid;
+  if (posix_spawn(&pid, "/bin/sh", nullptr, nullptr,
+                  const_cast<char *const *>(argv), environ) != 0)
+    return -1;
+  int status;
+  while (waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR)
+      return -1;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+bool measure_command(const std::string &command, CommandUsage &usage) {
+  // The command runs under a child of its own, whose RUSAGE_CHILDREN then
+  // covers exactly the command and everything it waited for, such as the
+  // compiler proper under a driver.
+  int fds[2];
+  if (pipe(fds) != 0)
+    return false;
+  std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid == -1) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    CommandUsage child_usage;
+    child_usage.status = run_command(command);
+    struct rusage children;
+    getrusage(RUSAGE_CHILDREN, &children);
+    child_usage.cpu_seconds =
+        children.ru_utime.tv_sec + children.ru_utime.tv_usec / 1e6 +
+        children.ru_stime.tv_sec + children.ru_stime.tv_usec / 1e6;
+    child_usage.peak_rss_kb = children.ru_maxrss;
+    ssize_t written = write(fds[1], &child_usage, sizeof(child_usage));
+    _exit(written == ssize_t(sizeof(child_usage)) ? 0 : 1);
+  }
+  close(fds[1]);
+  ssize_t got;
+  do {
+    got = read(fds[0], &usage, sizeof(usage));
+  } while (got == -1 && errno == EINTR);
+  close(fds[0]);
+  int status;
+  while (waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR)
+      return false;
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+  usage.wall_seconds = elapsed.count();
+  return got == ssize_t(sizeof(usage));
+}
+
+std::string shell_quote(const std::string &word) {
+  std::string quoted = "'";
+  for (char c : word) {
+    if (c == '\'')
+      quoted += "'\\''";
+    else
+      quoted += c;
+  }
+  quoted += '\'';
+  return quoted;
+}
+
+bool make_directory(const std::string &path) {
+  if (mkdir(path.c_str(), 0777) == 0)
+    return true;
+  struct stat info;
+  return errno == EEXIST && stat(path.c_str(), &info) == 0 &&
+         S_ISDIR(info.st_mode);
+}
+
+int listen_unix_socket(const std::string &path) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    return -1;
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    return -1;
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(fd, 16) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
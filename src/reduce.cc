@@ -0,0 +1,243 @@
+#include "reduce.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "type.h"
+
+void enumerate_reductions(const GenerationContext &context,
+                          std::vector<Reduction> &reductions) {
+  const std::vector<Class *> &types = context.types;
+  int num_types = types.size();
+  // Later classes are used by fewer others, so they are tried first.
+  for (int class_i = num_types - 1; class_i >= 0; --class_i)
+    reductions.push_back(Reduction{Reduction::Kind_RemoveClass, class_i, -1});
+  for (int class_i = 0; class_i < num_types; ++class_i) {
+    const Class &type = *types[class_i];
+    for (size_t base_i = 0; base_i < type.direct_bases.size(); ++base_i)
+      reductions.push_back(
+          Reduction{Reduction::Kind_RemoveBase, class_i, (int)base_i});
+    for (size_t method_i = 0; method_i < type.methods.size(); ++method_i)
+      reductions.push_back(
+          Reduction{Reduction::Kind_RemoveMethod, class_i, (int)method_i});
+    for (size_t field_i = 0; field_i < type.fields.size(); ++field_i)
+      reductions.push_back(
+          Reduction{Reduction::Kind_RemoveField, class_i, (int)field_i});
+  }
+  for (int class_i = 0; class_i < num_types; ++class_i) {
+    const Class &type = *types[class_i];
+    for (size_t field_i = 0; field_i < type.fields.size(); ++field_i) {
+      const Class::Field &field = type.fields[field_i];
+      if (!field.array_dimensions.empty())
+        reductions.push_back(Reduction{Reduction::Kind_RemoveArrayDimension,
+                                       class_i, (int)field_i});
+      // Unnamed members must be bitfields, so only named ones lose widths.
+      if (field.bitfield_width > -1 && !field.is_anonymous)
+        reductions.push_back(Reduction{Reduction::Kind_RemoveBitfieldWidth,
+                                       class_i, (int)field_i});
+      if (field.alignment > -1)
+        reductions.push_back(Reduction{Reduction::Kind_RemoveFieldAlignment,
+                                       class_i, (int)field_i});
+    }
+    if (type.packed > -1)
+      reductions.push_back(
+          Reduction{Reduction::Kind_RemovePacked, class_i, -1});
+    if (type.alignment > -1)
+      reductions.push_back(
+          Reduction{Reduction::Kind_RemoveAlignment, class_i, -1});
+    if (type.vtordisp > -1)
+      reductions.push_back(
+          Reduction{Reduction::Kind_RemoveVtordisp, class_i, -1});
+  }
+}
+
+static bool refers_to_dropped(TypeKind kind, int type_class,
+                              const std::vector<int> &new_index) {
+  return kind >= TypeKind_PClass && new_index[type_class] == -1;
+}
+
+// Copies the classes of `from` whose `new_index` is not -1 into `to`, at that
+// index, together with `from_order` restricted to them.  Bases, fields and
+// methods that refer to a dropped class are dropped too, and `reduction`, if
+// any, is applied along the way.
+static void copy_program(const GenerationContext &from,
+                         const std::vector<int> &from_order,
+                         const std::vector<int> &new_index,
+                         const Reduction *reduction, GenerationContext &to,
+                         std::vector<int> &to_order) {
+  auto applies_to = [reduction](Reduction::Kind kind, int class_i,
+                                int index) {
+    return reduction && reduction->kind == kind &&
+           reduction->class_i == class_i && reduction->index == index;
+  };
+
+  int num_types = from.types.size();
+  for (int class_i = 0; class_i < num_types; ++class_i) {
+    if (new_index[class_i] == -1)
+      continue;
+    const Class &type = *from.types[class_i];
+    Class *copy = to.arena.create<Class>(new_index[class_i], to.arena);
+
+    for (size_t base_i = 0; base_i < type.direct_bases.size(); ++base_i) {
+      int base = type.direct_bases[base_i];
+      if (new_index[base] == -1 ||
+          applies_to(Reduction::Kind_RemoveBase, class_i, base_i))
+        continue;
+      copy->add_base(to, new_index[base], type.is_direct_vbase(base));
+    }
+
+    for (size_t field_i = 0; field_i < type.fields.size(); ++field_i) {
+      const Class::Field &field = type.fields[field_i];
+      if (refers_to_dropped(field.type, field.type_class, new_index) ||
+          applies_to(Reduction::Kind_RemoveField, class_i, field_i))
+        continue;
+      Class::Field &field_copy = copy->add_field(field.type);
+      if (field.type_class != -1)
+        field_copy.set_type_class(new_index[field.type_class]);
+      field_copy.array_dimensions.assign(field.array_dimensions.begin(),
+                                         field.array_dimensions.end());
+      if (applies_to(Reduction::Kind_RemoveArrayDimension, class_i, field_i))
+        field_copy.array_dimensions.pop_back();
+      if (!applies_to(Reduction::Kind_RemoveBitfieldWidth, class_i,
+                      field_i)) {
+        field_copy.bitfield_width = field.bitfield_width;
+        field_copy.is_anonymous = field.is_anonymous;
+      }
+      if (!applies_to(Reduction::Kind_RemoveFieldAlignment, class_i,
+                      field_i))
+        field_copy.set_alignment(field.alignment,
+                                 field.gnu_alignment_spelling);
+    }
+
+    for (size_t method_i = 0; method_i < type.methods.size(); ++method_i) {
+      Class::Method method = type.methods[method_i];
+      if (refers_to_dropped(method.ret_type, method.ret_type_class,
+                            new_index) ||
+          refers_to_dropped(method.arg_type, method.arg_type_class,
+                            new_index) ||
+          applies_to(Reduction::Kind_RemoveMethod, class_i, method_i))
+        continue;
+      if (method.name_class != -1)
+        method.name_class = new_index[method.name_class];
+      if (method.ret_type_class != -1)
+        method.ret_type_class = new_index[method.ret_type_class];
+      if (method.arg_type_class != -1)
+        method.arg_type_class = new_index[method.arg_type_class];
+      copy->add_method(method);
+    }
+
+    if (!applies_to(Reduction::Kind_RemovePacked, class_i, -1))
+      copy->set_packed(type.packed);
+    if (!applies_to(Reduction::Kind_RemoveAlignment, class_i, -1))
+      copy->set_alignment(type.alignment, type.gnu_alignment_spelling);
+    if (!applies_to(Reduction::Kind_RemoveVtordisp, class_i, -1))
+      copy->set_vtordisp(type.vtordisp);
+    copy->set_ctor(type.has_ctor);
+    copy->set_dllexport(type.has_dllexport);
+    append_class(to, copy);
+  }
+
+  to_order.clear();
+  for (int class_i : from_order) {
+    if (new_index[class_i] != -1)
+      to_order.push_back(new_index[class_i]);
+  }
+}
+
+void apply_reduction(const GenerationContext &from,
+                     const std::vector<int> &from_order,
+                     const Reduction &reduction, GenerationContext &to,
+                     std::vector<int> &to_order) {
+  std::vector<int> new_index(from.types.size());
+  int next_index = 0;
+  for (size_t class_i = 0; class_i < new_index.size(); ++class_i) {
+    bool removed = reduction.kind == Reduction::Kind_RemoveClass &&
+                   reduction.class_i == (int)class_i;
+    new_index[class_i] = removed ? -1 : next_index++;
+  }
+  copy_program(from, from_order, new_index, &reduction, to, to_order);
+}
+
+void slice_program(const GenerationContext &from, int slice_class,
+                   GenerationContext &to, std::vector<int> &to_order) {
+  // Classes only refer to themselves and to earlier classes, so one pass
+  // downwards from `slice_class` finds everything it needs.
+  std::vector<char> needed(from.types.size(), false);
+  needed[slice_class] = true;
+  auto need = [&needed](TypeKind kind, int type_class) {
+    if (kind >= TypeKind_PClass)
+      needed[type_class] = true;
+  };
+  for (int class_i = slice_class; class_i >= 0; --class_i) {
+    if (!needed[class_i])
+      continue;
+    const Class &type = *from.types[class_i];
+    for (int base : type.direct_bases)
+      needed[base] = true;
+    for (const Class::Field &field : type.fields)
+      need(field.type, field.type_class);
+    for (const Class::Method &method : type.methods) {
+      need(method.ret_type, method.ret_type_class);
+      need(method.arg_type, method.arg_type_class);
+    }
+  }
+
+  std::vector<int> new_index(from.types.size());
+  int next_index = 0;
+  for (size_t class_i = 0; class_i < new_index.size(); ++class_i)
+    new_index[class_i] = needed[class_i] ? next_index++ : -1;
+  std::vector<int> from_order(1, slice_class);
+  copy_program(from, from_order, new_index, nullptr, to, to_order);
+}
+
+void reduce_program(std::unique_ptr<GenerationContext> &context,
+                    std::vector<int> &test_order, int num_jobs,
+                    const InterestingnessTest &is_interesting) {
+  num_jobs = std::max(num_jobs, 1);
+  // Reductions are retried from where the last successful one was found;
+  // the program is fully reduced once a pass from the start finds nothing.
+  size_t start = 0;
+  for (;;) {
+    std::vector<Reduction> reductions;
+    enumerate_reductions(*context, reductions);
+
+    bool reduced = false;
+    for (size_t batch = start; batch < reductions.size() && !reduced;
+         batch += num_jobs) {
+      size_t batch_size =
+          std::min<size_t>(num_jobs, reductions.size() - batch);
+      std::vector<std::unique_ptr<GenerationContext>> candidates(batch_size);
+      std::vector<std::vector<int>> orders(batch_size);
+      std::vector<char> interesting(batch_size, false);
+      auto try_candidate = [&](size_t slot) {
+        candidates[slot].reset(new GenerationContext(0));
+        apply_reduction(*context, test_order, reductions[batch + slot],
+                        *candidates[slot], orders[slot]);
+        interesting[slot] = is_interesting(*candidates[slot], orders[slot],
+                                           slot);
+      };
+      std::vector<std::thread> threads;
+      for (size_t slot = 1; slot < batch_size; ++slot)
+        threads.emplace_back(try_candidate, slot);
+      try_candidate(0);
+      for (auto &thread : threads)
+        thread.join();
+
+      for (size_t slot = 0; slot < batch_size; ++slot) {
+        if (!interesting[slot])
+          continue;
+        context = std::move(candidates[slot]);
+        test_order = orders[slot];
+        start = batch + slot;
+        reduced = true;
+        break;
+      }
+    }
+
+    if (!reduced) {
+      if (start == 0)
+        return;
+      start = 0;
+    }
+  }
+}
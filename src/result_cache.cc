@@ -0,0 +1,202 @@
+#include "result_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Every record is the magic, the key size, the payload size and a checksum
+// of key and payload, followed by the key and the payload.  The payload is
+// the compile status, the run status and the output.
+static const char kRecordMagic[4] = {'S', 'F', 'Z', 'R'};
+static const size_t kHeaderSize = 4 + 4 + 4 + 8;
+static const size_t kStatusSize = 4 + 4;
+
+static uint64_t mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+namespace {
+
+// Two independently seeded lanes of splitmix64 over 8-byte words.
+class ContentHasher {
+ public:
+  ContentHasher() : lanes{0, 0x243f6a8885a308d3ull} {}
+
+  void add_word(uint64_t word) {
+    lanes[0] = mix(lanes[0] ^ word);
+    lanes[1] = mix(lanes[1] ^ word);
+  }
+
+  void add(const char *data, size_t size) {
+    add_word(size);
+    for (; size >= 8; data += 8, size -= 8) {
+      uint64_t word;
+      memcpy(&word, data, 8);
+      add_word(word);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data, size);
+    add_word(tail);
+  }
+
+  uint64_t lanes[2];
+};
+
+}  // namespace
+
+static void put_u32(std::string &out, uint32_t value) {
+  for (int byte_i = 0; byte_i < 4; ++byte_i)
+    out += char(value >> (8 * byte_i));
+}
+
+static void put_u64(std::string &out, uint64_t value) {
+  for (int byte_i = 0; byte_i < 8; ++byte_i)
+    out += char(value >> (8 * byte_i));
+}
+
+static uint64_t get_le(const unsigned char *bytes, int size) {
+  uint64_t value = 0;
+  for (int byte_i = size - 1; byte_i >= 0; --byte_i)
+    value = value << 8 | bytes[byte_i];
+  return value;
+}
+
+static uint64_t checksum(const char *data, size_t size) {
+  ContentHasher hasher;
+  hasher.add(data, size);
+  return hasher.lanes[0];
+}
+
+static bool read_at(int fd, uint64_t offset, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t got = pread(fd, data, size, offset);
+    if (got <= 0)
+      return false;
+    data += got;
+    size -= got;
+    offset += got;
+  }
+  return true;
+}
+
+// Returns the offset of the first record magic after `offset`, or `end`.
+static uint64_t find_next_record(int fd, uint64_t offset, uint64_t end) {
+  const size_t chunk_size = 1 << 16;
+  const std::string magic(kRecordMagic, sizeof(kRecordMagic));
+  std::string chunk;
+  for (uint64_t start = offset + 1; start < end;
+       start += chunk_size - sizeof(kRecordMagic) + 1) {
+    chunk.resize(std::min<uint64_t>(chunk_size, end - start));
+    if (!read_at(fd, start, &chunk[0], chunk.size()))
+      return end;
+    size_t found = chunk.find(magic);
+    if (found != std::string::npos)
+      return start + found;
+    if (chunk.size() < chunk_size)
+      break;
+  }
+  return end;
+}
+
+std::string content_hash(const std::vector<std::string> &parts) {
+  ContentHasher hasher;
+  hasher.add_word(parts.size());
+  for (const std::string &part : parts)
+    hasher.add(part.data(), part.size());
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (uint64_t lane : hasher.lanes) {
+    for (int shift = 60; shift >= 0; shift -= 4)
+      hex += digits[(lane >> shift) & 0xf];
+  }
+  return hex;
+}
+
+ResultCache::~ResultCache() {
+  if (fd != -1)
+    close(fd);
+}
+
+bool ResultCache::open(const std::string &path) {
+  fd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CREAT, 0666);
+  if (fd == -1)
+    return false;
+  std::lock_guard<std::mutex> lock(mutex);
+  scan();
+  return true;
+}
+
+// Called with the mutex held.
+void ResultCache::scan() {
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+    return;
+  uint64_t end = info.st_size;
+  std::string record;
+  while (scanned + kHeaderSize <= end) {
+    unsigned char header[kHeaderSize];
+    if (!read_at(fd, scanned, reinterpret_cast<char *>(header), kHeaderSize))
+      return;
+    uint64_t key_size = get_le(header + 4, 4);
+    uint64_t payload_size = get_le(header + 8, 4);
+    uint64_t record_end = scanned + kHeaderSize + key_size + payload_size;
+    bool valid = memcmp(header, kRecordMagic, sizeof(kRecordMagic)) == 0 &&
+                 payload_size >= kStatusSize && record_end <= end;
+    if (valid) {
+      record.resize(key_size + payload_size);
+      valid =
+          read_at(fd, scanned + kHeaderSize, &record[0], record.size()) &&
+          checksum(record.data(), record.size()) == get_le(header + 12, 8);
+    }
+    // A torn record is skipped, as is one still being written; missing it
+    // only costs a cache miss.  Waiting for it could wait forever on a torn
+    // header.
+    if (!valid) {
+      scanned = find_next_record(fd, scanned, end);
+      continue;
+    }
+    entries[record.substr(0, key_size)] =
+        Entry{scanned + kHeaderSize + key_size, uint32_t(payload_size)};
+    scanned = record_end;
+  }
+}
+
+bool ResultCache::lookup(const std::string &key, CachedResult &result) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto entry = entries.find(key);
+  if (entry == entries.end()) {
+    scan();
+    entry = entries.find(key);
+    if (entry == entries.end())
+      return false;
+  }
+  std::string payload(entry->second.size, '\0');
+  if (!read_at(fd, entry->second.offset, &payload[0], payload.size()))
+    return false;
+  const unsigned char *bytes =
+      reinterpret_cast<const unsigned char *>(payload.data());
+  result.compile_status = int32_t(get_le(bytes, 4));
+  result.run_status = int32_t(get_le(bytes + 4, 4));
+  result.output = payload.substr(kStatusSize);
+  return true;
+}
+
+bool ResultCache::store(const std::string &key, const CachedResult &result) {
+  std::string body = key;
+  put_u32(body, uint32_t(result.compile_status));
+  put_u32(body, uint32_t(result.run_status));
+  body += result.output;
+
+  std::string record(kRecordMagic, sizeof(kRecordMagic));
+  put_u32(record, key.size());
+  put_u32(record, body.size() - key.size());
+  put_u64(record, checksum(body.data(), body.size()));
+  record += body;
+  // One write, so that records from concurrent writers never interleave.
+  return write(fd, record.data(), record.size()) == ssize_t(record.size());
+}
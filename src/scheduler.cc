@@ -0,0 +1,117 @@
+#include "scheduler.h"
+
+#include <iomanip>
+#include <sstream>
+
+// The prior on every arm's rate: as if it had found one new mismatch in
+// kPriorSeconds, so that untried arms look promising until they are tried.
+static const double kPriorMismatches = 1;
+static const double kPriorSeconds = 10;
+
+bool ArmScheduler::load_arms(const std::string &path, std::string &error) {
+  std::ifstream in(path);
+  if (!in) {
+    error = "could not read " + path;
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#')
+      continue;
+    arms.push_back(Arm{line.substr(start), 0, 0, 0});
+  }
+  if (arms.empty()) {
+    error = path + " has no arms";
+    return false;
+  }
+  return true;
+}
+
+bool ArmScheduler::load_replay(const std::string &path, std::string &error) {
+  std::ifstream in(path);
+  if (!in) {
+    error = "could not read " + path;
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string event;
+    fields >> event;
+    if (event == "arm") {
+      // The log must come from a campaign with the same arms.
+      int arm;
+      std::string arguments;
+      fields >> arm >> std::ws;
+      std::getline(fields, arguments);
+      if (arm < 0 || arm >= num_arms() || arguments != arms[arm].arguments) {
+        error = path + " was logged with different arms";
+        return false;
+      }
+    } else if (event == "choose") {
+      unsigned long seed;
+      int arm;
+      if (!(fields >> seed >> arm) || arm < 0 || arm >= num_arms()) {
+        error = "malformed line in " + path + ": " + line;
+        return false;
+      }
+      replay[seed] = arm;
+    }
+  }
+  return true;
+}
+
+bool ArmScheduler::open_log(const std::string &path) {
+  log.open(path);
+  for (size_t arm = 0; arm < arms.size(); ++arm)
+    log << "arm " << arm << ' ' << arms[arm].arguments << '\n';
+  log.flush();
+  return bool(log);
+}
+
+int ArmScheduler::choose(unsigned long seed) {
+  int chosen = 0;
+  auto replayed = replay.find(seed);
+  if (replayed != replay.end()) {
+    chosen = replayed->second;
+  } else {
+    double best_rate = -1;
+    for (size_t arm = 0; arm < arms.size(); ++arm) {
+      std::gamma_distribution<double> rate_dist(
+          kPriorMismatches + arms[arm].num_new,
+          1 / (kPriorSeconds + arms[arm].seconds));
+      double rate = rate_dist(random);
+      if (rate > best_rate) {
+        best_rate = rate;
+        chosen = arm;
+      }
+    }
+  }
+  if (log.is_open()) {
+    log << "choose " << seed << ' ' << chosen << '\n';
+    log.flush();
+  }
+  return chosen;
+}
+
+void ArmScheduler::report(unsigned long seed, int arm, double seconds,
+                          int num_new) {
+  ++arms[arm].num_seeds;
+  arms[arm].seconds += seconds;
+  arms[arm].num_new += num_new;
+  if (log.is_open()) {
+    log << "outcome " << seed << ' ' << arm << ' ' << std::fixed
+        << std::setprecision(3) << seconds << ' ' << num_new << '\n';
+    log.flush();
+  }
+}
+
+void ArmScheduler::print_summary(std::ostream &out) const {
+  for (size_t arm = 0; arm < arms.size(); ++arm) {
+    out << "arm " << arm << ": " << arms[arm].num_seeds << " seeds, "
+        << std::fixed << std::setprecision(1) << arms[arm].seconds << "s, "
+        << arms[arm].num_new << " new distinct mismatches: "
+        << arms[arm].arguments << '\n';
+  }
+}
@@ -0,0 +1,296 @@
+#include "snapshot.h"
+
+#include <climits>
+#include <cstring>
+#include <fstream>
+
+#include "mapped_file.h"
+#include "type.h"
+
+static const char kSnapshotMagic[8] = {'S', 'F', 'Z', 'S', 'N', 'A', 'P', 0};
+
+enum SnapshotFlag {
+  SnapshotFlag_GnuDialect = 1 << 0,
+  SnapshotFlag_CheckVptrs = 1 << 1,
+  SnapshotFlag_Swarm = 1 << 2,
+  SnapshotFlag_PmfFields = 1 << 3,
+  SnapshotFlag_PdmFields = 1 << 4,
+};
+
+enum ClassFlag {
+  ClassFlag_GnuAlignmentSpelling = 1 << 0,
+  ClassFlag_HasCtor = 1 << 1,
+  ClassFlag_HasDllexport = 1 << 2,
+};
+
+enum FieldFlag {
+  FieldFlag_Anonymous = 1 << 0,
+  FieldFlag_GnuAlignmentSpelling = 1 << 1,
+};
+
+enum MethodFlag {
+  MethodFlag_Virtual = 1 << 0,
+  MethodFlag_Pure = 1 << 1,
+};
+
+namespace {
+
+class SnapshotWriter {
+ public:
+  void put(uint64_t value) {
+    while (value >= 0x80) {
+      bytes += char(value | 0x80);
+      value >>= 7;
+    }
+    bytes += char(value);
+  }
+
+  // Values that are -1 when unset.
+  void put_optional(int value) { put(uint64_t(value + 1)); }
+
+  void put_type(TypeKind type, int type_class) {
+    put(type);
+    if (type >= TypeKind_PClass)
+      put(type_class);
+  }
+
+  std::string bytes;
+};
+
+class SnapshotReader {
+ public:
+  SnapshotReader(const unsigned char *begin, const unsigned char *end)
+      : ptr(begin), end(end), failed(false) {}
+
+  uint64_t get() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (ptr == end)
+        break;
+      unsigned char byte = *ptr++;
+      value |= uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+    failed = true;
+    return 0;
+  }
+
+  int get_int(int max) {
+    uint64_t value = get();
+    if (max < 0 || value > uint64_t(max)) {
+      failed = true;
+      return 0;
+    }
+    return int(value);
+  }
+
+  int get_optional(int max) { return get_int(max + 1) - 1; }
+
+  // Element counts: every element takes at least a byte, so anything larger
+  // than what is left is corrupt, and is rejected before it is allocated.
+  size_t get_count() {
+    uint64_t count = get();
+    if (count > uint64_t(end - ptr)) {
+      failed = true;
+      return 0;
+    }
+    return count;
+  }
+
+  // Reads a type and, for class-valued kinds, the class it names, which
+  // must come no later than `max_class`.
+  TypeKind get_type(int max_class, int &type_class) {
+    TypeKind type = TypeKind(get_int(TypeKind_Class));
+    type_class = -1;
+    if (type >= TypeKind_PClass)
+      type_class = get_int(max_class);
+    return type;
+  }
+
+  bool at_end() const { return ptr == end; }
+
+  const unsigned char *ptr;
+  const unsigned char *end;
+  bool failed;
+};
+
+}  // namespace
+
+bool write_snapshot(const std::string &path, const GenerationContext &context,
+                    const std::vector<int> &test_order,
+                    const SnapshotInfo &info) {
+  SnapshotWriter writer;
+  writer.bytes.assign(kSnapshotMagic, sizeof(kSnapshotMagic));
+  writer.put(kSnapshotVersion);
+  writer.put((info.gnu_dialect ? SnapshotFlag_GnuDialect : 0) |
+             (info.check_vptrs ? SnapshotFlag_CheckVptrs : 0) |
+             (info.swarm ? SnapshotFlag_Swarm : 0) |
+             (info.pmf_fields ? SnapshotFlag_PmfFields : 0) |
+             (info.pdm_fields ? SnapshotFlag_PdmFields : 0));
+  writer.put(info.seed);
+  if (info.swarm) {
+    writer.put(info.swarm_chances.size());
+    for (int chance : info.swarm_chances)
+      writer.put(chance);
+  }
+
+  writer.put(context.types.size());
+  for (const Class *type : context.types) {
+    writer.put_optional(type->alignment);
+    writer.put_optional(type->packed);
+    writer.put_optional(type->vtordisp);
+    writer.put(
+        (type->gnu_alignment_spelling ? ClassFlag_GnuAlignmentSpelling : 0) |
+        (type->has_ctor ? ClassFlag_HasCtor : 0) |
+        (type->has_dllexport ? ClassFlag_HasDllexport : 0));
+
+    writer.put(type->direct_bases.size());
+    for (int base : type->direct_bases)
+      writer.put(uint64_t(base) << 1 | type->is_direct_vbase(base));
+
+    writer.put(type->fields.size());
+    for (const Class::Field &field : type->fields) {
+      writer.put_type(field.type, field.type_class);
+      writer.put_optional(field.bitfield_width);
+      writer.put_optional(field.alignment);
+      writer.put((field.is_anonymous ? FieldFlag_Anonymous : 0) |
+                 (field.gnu_alignment_spelling
+                      ? FieldFlag_GnuAlignmentSpelling
+                      : 0));
+      writer.put(field.array_dimensions.size());
+      for (int dimension : field.array_dimensions)
+        writer.put(dimension);
+    }
+
+    writer.put(type->methods.size());
+    for (const Class::Method &method : type->methods) {
+      writer.put_optional(method.name_class);
+      writer.put_type(method.ret_type, method.ret_type_class);
+      writer.put_type(method.arg_type, method.arg_type_class);
+      writer.put((method.is_virtual ? MethodFlag_Virtual : 0) |
+                 (method.is_pure ? MethodFlag_Pure : 0));
+    }
+  }
+
+  writer.put(test_order.size());
+  for (int class_i : test_order)
+    writer.put(class_i);
+
+  std::ofstream out(path, std::ios::binary);
+  out.write(writer.bytes.data(), writer.bytes.size());
+  return bool(out);
+}
+
+bool read_snapshot(const std::string &path, GenerationContext &context,
+                   std::vector<int> &test_order, SnapshotInfo &info,
+                   std::string &error) {
+  MappedFile file;
+  if (!file.map(path)) {
+    error = "could not map " + path;
+    return false;
+  }
+  SnapshotReader reader(file.begin(), file.end());
+  if (file.end() - file.begin() < (long)sizeof(kSnapshotMagic) ||
+      memcmp(file.begin(), kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) {
+    error = path + " is not a snapshot";
+    return false;
+  }
+  reader.ptr += sizeof(kSnapshotMagic);
+
+  uint64_t version = reader.get();
+  if (reader.failed || version < 1 || version > kSnapshotVersion) {
+    error = path + " has unsupported snapshot version " +
+            std::to_string(version);
+    return false;
+  }
+  uint64_t flags = reader.get();
+  info.gnu_dialect = flags & SnapshotFlag_GnuDialect;
+  info.check_vptrs = flags & SnapshotFlag_CheckVptrs;
+  info.swarm = flags & SnapshotFlag_Swarm;
+  info.pmf_fields = flags & SnapshotFlag_PmfFields;
+  info.pdm_fields = flags & SnapshotFlag_PdmFields;
+  info.seed = reader.get();
+  info.swarm_chances.clear();
+  if (info.swarm) {
+    size_t num_chances = reader.get_count();
+    for (size_t chance_i = 0; chance_i < num_chances && !reader.failed;
+         ++chance_i)
+      info.swarm_chances.push_back(reader.get_int(100));
+  }
+
+  size_t num_types = reader.get_count();
+  for (size_t class_i = 0; class_i < num_types && !reader.failed;
+       ++class_i) {
+    // Classes only refer to themselves and to earlier classes, and contain
+    // only earlier ones by value.
+    int max_class = class_i;
+    Class *type = context.arena.create<Class>(class_i, context.arena);
+    int alignment = reader.get_optional(INT_MAX - 1);
+    type->set_packed(reader.get_optional(INT_MAX - 1));
+    type->set_vtordisp(reader.get_optional(INT_MAX - 1));
+    uint64_t class_flags = reader.get();
+    type->set_alignment(alignment,
+                        class_flags & ClassFlag_GnuAlignmentSpelling);
+    type->set_ctor(class_flags & ClassFlag_HasCtor);
+    type->set_dllexport(class_flags & ClassFlag_HasDllexport);
+
+    size_t num_bases = reader.get_count();
+    for (size_t base_i = 0; base_i < num_bases && !reader.failed; ++base_i) {
+      uint64_t base = reader.get();
+      if ((base >> 1) >= class_i) {
+        reader.failed = true;
+        break;
+      }
+      type->add_base(context, base >> 1, base & 1);
+    }
+
+    size_t num_fields = reader.get_count();
+    for (size_t field_i = 0; field_i < num_fields && !reader.failed;
+         ++field_i) {
+      int type_class;
+      TypeKind field_type = reader.get_type(max_class, type_class);
+      if (field_type == TypeKind_Class && type_class == max_class) {
+        reader.failed = true;
+        break;
+      }
+      Class::Field &field = type->add_field(field_type);
+      field.set_type_class(type_class);
+      field.bitfield_width = reader.get_optional(INT_MAX - 1);
+      int field_alignment = reader.get_optional(INT_MAX - 1);
+      uint64_t field_flags = reader.get();
+      field.is_anonymous = field_flags & FieldFlag_Anonymous;
+      field.set_alignment(field_alignment,
+                          field_flags & FieldFlag_GnuAlignmentSpelling);
+      size_t num_dimensions = reader.get_count();
+      for (size_t dimension_i = 0; dimension_i < num_dimensions;
+           ++dimension_i)
+        field.add_array_dimension(reader.get_int(INT_MAX));
+    }
+
+    size_t num_methods = reader.get_count();
+    for (size_t method_i = 0; method_i < num_methods && !reader.failed;
+         ++method_i) {
+      Class::Method method;
+      method.name_class = reader.get_optional(max_class);
+      method.ret_type = reader.get_type(max_class, method.ret_type_class);
+      method.arg_type = reader.get_type(max_class, method.arg_type_class);
+      uint64_t method_flags = reader.get();
+      method.is_virtual = method_flags & MethodFlag_Virtual;
+      method.is_pure = method_flags & MethodFlag_Pure;
+      type->add_method(method);
+    }
+    append_class(context, type);
+  }
+
+  size_t num_tests = reader.get_count();
+  test_order.clear();
+  for (size_t test_i = 0; test_i < num_tests && !reader.failed; ++test_i)
+    test_order.push_back(reader.get_int(int(num_types) - 1));
+
+  if (reader.failed || !reader.at_end()) {
+    error = path + " is corrupt";
+    return false;
+  }
+  return true;
+}
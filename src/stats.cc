@@ -0,0 +1,118 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const char *const kPhaseNames[GenerationPhase_Count] = {
+    "bases", "fields", "methods", "attributes", "emission",
+};
+
+static const char *const kTypeKindNames[TypeKind_Class + 1] = {
+    "bool",   "char",   "short", "int", "long_long", "float",
+    "double", "pclass", "pmf",   "pdm", "class",
+};
+
+GenerationStats::GenerationStats() { memset(this, 0, sizeof(*this)); }
+
+void GenerationStats::count_class(const Class &type) {
+  ++classes;
+  for (int base : type.direct_bases) {
+    ++bases;
+    if (type.is_direct_vbase(base))
+      ++virtual_bases;
+  }
+  for (const Class::Field &field : type.fields) {
+    ++fields_by_kind[field.type];
+    if (field.bitfield_width > -1) {
+      ++bitfields;
+      if (field.is_anonymous)
+        ++anonymous_bitfields;
+    }
+    if (!field.array_dimensions.empty())
+      ++array_fields;
+    if (field.alignment > -1)
+      ++aligned_fields;
+  }
+  for (const Class::Method &method : type.methods) {
+    if (method.name_class == -1)
+      ++override_methods;
+    else
+      ++own_methods;
+    if (method.is_virtual)
+      ++virtual_methods;
+    if (method.is_pure)
+      ++pure_methods;
+  }
+  if (type.packed > -1)
+    ++packed_classes;
+  if (type.alignment > -1)
+    ++aligned_classes;
+  if (type.vtordisp > -1)
+    ++vtordisp_classes;
+  if (type.has_ctor)
+    ++classes_with_ctor;
+}
+
+void GenerationStats::merge(const GenerationStats &other) {
+  for (int phase = 0; phase < GenerationPhase_Count; ++phase)
+    phase_nanoseconds[phase] += other.phase_nanoseconds[phase];
+  programs += other.programs;
+  classes += other.classes;
+  bases += other.bases;
+  virtual_bases += other.virtual_bases;
+  rejected_bases += other.rejected_bases;
+  for (int kind = 0; kind <= TypeKind_Class; ++kind)
+    fields_by_kind[kind] += other.fields_by_kind[kind];
+  bitfields += other.bitfields;
+  anonymous_bitfields += other.anonymous_bitfields;
+  array_fields += other.array_fields;
+  aligned_fields += other.aligned_fields;
+  own_methods += other.own_methods;
+  override_methods += other.override_methods;
+  virtual_methods += other.virtual_methods;
+  pure_methods += other.pure_methods;
+  packed_classes += other.packed_classes;
+  aligned_classes += other.aligned_classes;
+  vtordisp_classes += other.vtordisp_classes;
+  classes_with_ctor += other.classes_with_ctor;
+  bytes_emitted += other.bytes_emitted;
+  peak_arena_bytes += other.peak_arena_bytes;
+}
+
+void GenerationStats::write_json(std::ostream &out,
+                                 double wall_seconds) const {
+  out << "{\n";
+  out << "  \"wall_seconds\": " << wall_seconds << ",\n";
+  out << "  \"phase_seconds\": {";
+  for (int phase = 0; phase < GenerationPhase_Count; ++phase) {
+    out << (phase ? ", " : "") << '"' << kPhaseNames[phase]
+        << "\": " << phase_nanoseconds[phase] / 1e9;
+  }
+  out << "},\n";
+  out << "  \"programs\": " << programs << ",\n";
+  out << "  \"classes\": " << classes << ",\n";
+  out << "  \"bases\": {\"total\": " << bases
+      << ", \"virtual\": " << virtual_bases
+      << ", \"rejected\": " << rejected_bases << "},\n";
+  out << "  \"fields_by_kind\": {";
+  for (int kind = 0; kind <= TypeKind_Class; ++kind) {
+    out << (kind ? ", " : "") << '"' << kTypeKindNames[kind]
+        << "\": " << fields_by_kind[kind];
+  }
+  out << "},\n";
+  out << "  \"field_attributes\": {\"bitfield\": " << bitfields
+      << ", \"anonymous_bitfield\": " << anonymous_bitfields
+      << ", \"array\": " << array_fields
+      << ", \"aligned\": " << aligned_fields << "},\n";
+  out << "  \"methods\": {\"own\": " << own_methods
+      << ", \"override\": " << override_methods
+      << ", \"virtual\": " << virtual_methods
+      << ", \"pure\": " << pure_methods << "},\n";
+  out << "  \"class_attributes\": {\"packed\": " << packed_classes
+      << ", \"aligned\": " << aligned_classes
+      << ", \"vtordisp\": " << vtordisp_classes
+      << ", \"ctor\": " << classes_with_ctor << "},\n";
+  out << "  \"bytes_emitted\": " << bytes_emitted << ",\n";
+  out << "  \"peak_arena_bytes\": " << peak_arena_bytes << "\n";
+  out << "}\n";
+}
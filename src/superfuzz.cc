@@ -1,15 +1,45 @@
 #include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
 
+#include "alias_table.h"
+#include "captured_layout.h"
+#include "context.h"
+#include "coverage.h"
+#include "dedup.h"
+#include "layout.h"
 #include "option.h"
+#include "output.h"
+#include "process.h"
+#include "random_stream.h"
+#include "reduce.h"
+#include "snapshot.h"
+#include "stats.h"
 #include "type.h"
 
-typedef std::mt19937 generator_type;
-static generator_type generator;
 static Option<unsigned long> seed("seed", generator_type::default_seed);
+// Batch mode: "A:B" generates one program per seed in [A, B] into out-dir.
+static Option<std::string> seed_range("seed-range");
+static Option<std::string> out_dir("out-dir", ".");
+static Option<int> jobs("jobs", 0);
 static Option<int> num_classes("num-classes", 30);
 static Option<int> min_num_fields("min-num-fields", 0);
 static Option<int> max_num_fields("max-num-fields", 30);
@@ -28,19 +58,326 @@ static Option<int> chance_of_class_aligned("chance-of-class-aligned", 10);
 static Option<int> chance_of_class_packed("chance-of-class-packed", 10);
 static Option<int> chance_of_class_vtordisp("chance-of-vtordisp-packed", 10);
 static Option<int> chance_of_field_aligned("chance-of-field-aligned", 10);
+// How often each kind of type is drawn for fields, return types and
+// argument types, relative to the others.
+static Option<int> weight_of_bool("weight-of-bool", 1);
+static Option<int> weight_of_char("weight-of-char", 1);
+static Option<int> weight_of_short("weight-of-short", 1);
+static Option<int> weight_of_int("weight-of-int", 1);
+static Option<int> weight_of_long_long("weight-of-long-long", 1);
+static Option<int> weight_of_float("weight-of-float", 1);
+static Option<int> weight_of_double("weight-of-double", 1);
+static Option<int> weight_of_pclass("weight-of-pclass", 1);
+static Option<int> weight_of_pmf("weight-of-pmf", 1);
+static Option<int> weight_of_pdm("weight-of-pdm", 1);
+static Option<int> weight_of_class("weight-of-class", 1);
 static Option<bool> check_vptrs("check-vptrs", false);
 static Option<bool> gnu_dialect("gnu-dialect", false);
+// Compute the expected layouts in-process (Itanium for the GNU dialect,
+// Microsoft otherwise) and make the program report any difference.
+static Option<bool> expected_layout("expected-layout", false);
 static Option<bool> show_help("help", false);
+// Pick bases in time proportional to the number picked rather than to the
+// number of earlier classes.  Programs differ from the default selection.
+static Option<bool> fast_base_selection("fast-base-selection", false);
+// Make the class before each class its first, non-virtual base, so that the
+// inheritance chain is as deep as there are classes.
+static Option<bool> base_chain("base-chain", false);
+// Write each class as soon as it is generated and keep only what later
+// classes need from it, so memory does not grow with every field and method.
+static Option<bool> stream_classes("stream", false);
+// Split each program into a header, a main file and this many files of
+// tests, plus a makefile that compiles them in parallel.
+static Option<int> shards("shards", 0);
+// Reduce the program for --seed while this command, run with the path of a
+// candidate program, exits with 0; then write the reduced program.
+static Option<std::string> reduce_command("reduce");
+// Emit only this class, the classes it needs and a main() that tests it.
+// The classes are renumbered from 0.
+static Option<int> slice("slice", -1);
+// Write the class model of each program to <seed>.snap in --out-dir instead
+// of the program itself.
+static Option<bool> write_snapshots("snapshot", false);
+// Start from the program in this snapshot instead of generating one.
+static Option<std::string> from_snapshot("from-snapshot");
+// Only test classes whose layouts are not in this index of layouts already
+// tested, skip programs that would test none, and add the new layouts.
+static Option<std::string> dedup_index("dedup-index");
 
-int main(int argc, const char *argv[]) {
-  parse_options(argc, argv);
+// Record which combinations of layout features the generated classes use in
+// this file, and report how many are covered.
+static Option<std::string> coverage_path("coverage-map");
+// Steer each class toward a combination of layout features that no class
+// has used yet.  Programs then depend on the coverage so far, not only on
+// their seed.
+static Option<bool> coverage_bias("coverage-bias", false);
 
-  if (show_help) {
-    usage(argv[0]);
-    return EXIT_SUCCESS;
+// Give every program its own configuration, derived from its seed, that
+// turns some features off and re-weights the rest.  The configuration is
+// written at the top of the program.
+static Option<bool> swarm("swarm", false);
+// "mt19937" draws every decision of a program from one sequential
+// generator.  "philox" gives each class, and each kind of decision in it,
+// a counter-based stream of its own keyed by the seed, so that the draws for
+// one class do not depend on how many numbers other classes drew.
+static Option<std::string> rng("rng", "mt19937");
+// Write a JSON report of where generation spent its time and what it
+// produced to this file at exit.
+static Option<std::string> stats_path("stats");
+// Check the program against the layouts a reference compiler's build of it
+// printed to this file, with static_asserts in place of the test harness,
+// so that compiling it is the whole test.
+static Option<std::string> static_asserts_path("static-asserts");
+// Stay resident and write one program per request read from stdin, or from
+// connections to --socket; see serve_request().
+static Option<bool> serve("serve", false);
+static Option<std::string> socket_path("socket");
+
+static LayoutIndex layout_index;
+static CoverageMap coverage;
+static GenerationStats run_stats;
+static CapturedLayouts captured_layouts;
+
+// The stats a single-program run counts into, or null without --stats.
+static GenerationStats *stats_for_run() {
+  return std::string(stats_path).empty() ? nullptr : &run_stats;
+}
+
+// The weight options, indexed by TypeKind.
+static const Option<int> *const kTypeKindWeights[TypeKind_Class + 1] = {
+    &weight_of_bool,   &weight_of_char,      &weight_of_short,
+    &weight_of_int,    &weight_of_long_long, &weight_of_float,
+    &weight_of_double, &weight_of_pclass,    &weight_of_pmf,
+    &weight_of_pdm,    &weight_of_class,
+};
+
+// The percentages one program's classes are generated with.
+struct FeatureChances {
+  int base;
+  int vbase;
+  int array;
+  int anon_field;
+  int bitfield;
+  int own_method;
+  int override_method;
+  int virt_override;
+  int pure_virt;
+  int class_aligned;
+  int class_packed;
+  int class_vtordisp;
+  int field_aligned;
+  bool pmf_fields;
+  bool pdm_fields;
+
+  // Whether fields may have this type.
+  bool allows_field(int type) const {
+    return (type != TypeKind_PMF || pmf_fields) &&
+           (type != TypeKind_PDM || pdm_fields);
+  }
+};
+
+struct SwarmChance {
+  const char *name;
+  const Option<int> &option;
+  int FeatureChances::*chance;
+};
+
+// The chances --swarm varies, named after their options.
+static const SwarmChance kSwarmChances[] = {
+    {"chance-of-base", chance_of_base, &FeatureChances::base},
+    {"chance-of-vbase", chance_of_vbase, &FeatureChances::vbase},
+    {"chance-of-array", chance_of_array, &FeatureChances::array},
+    {"chance-of-anon-field", chance_of_anon_field,
+     &FeatureChances::anon_field},
+    {"chance-of-bitfield", chance_of_bitfield, &FeatureChances::bitfield},
+    {"chance-of-own-method", chance_of_own_method,
+     &FeatureChances::own_method},
+    {"chance-of-override-method", chance_of_override_method,
+     &FeatureChances::override_method},
+    {"chance-of-virt-override", chance_of_virt_override,
+     &FeatureChances::virt_override},
+    {"chance-of-pure-virt", chance_of_pure_virt, &FeatureChances::pure_virt},
+    {"chance-of-class-aligned", chance_of_class_aligned,
+     &FeatureChances::class_aligned},
+    {"chance-of-class-packed", chance_of_class_packed,
+     &FeatureChances::class_packed},
+    {"chance-of-vtordisp-packed", chance_of_class_vtordisp,
+     &FeatureChances::class_vtordisp},
+    {"chance-of-field-aligned", chance_of_field_aligned,
+     &FeatureChances::field_aligned},
+};
+
+// Returns the chances from the options or, with --swarm, the configuration
+// of the program for `program_seed`: each feature is off with probability
+// 1/2, and otherwise its chance is drawn from [1, twice its option].  The
+// draws come from their own generator so that the classes are still drawn
+// from the seed alone.
+static FeatureChances feature_chances(unsigned long program_seed) {
+  FeatureChances chances;
+  for (const SwarmChance &swarm_chance : kSwarmChances)
+    chances.*swarm_chance.chance = swarm_chance.option;
+  chances.pmf_fields = chances.pdm_fields = true;
+  if (!swarm)
+    return chances;
+
+  std::seed_seq swarm_seed{uint32_t(program_seed),
+                           uint32_t(uint64_t(program_seed) >> 32),
+                           uint32_t(0x7377726d)};
+  generator_type swarm_generator(swarm_seed);
+  std::bernoulli_distribution enabled(0.5);
+  for (const SwarmChance &swarm_chance : kSwarmChances) {
+    int &chance = chances.*swarm_chance.chance;
+    int most = std::min(2 * std::max(chance, 0), 100);
+    if (!enabled(swarm_generator) || most == 0) {
+      chance = 0;
+      continue;
+    }
+    std::uniform_int_distribution<int> chance_dist(1, most);
+    chance = chance_dist(swarm_generator);
+  }
+  chances.pmf_fields = enabled(swarm_generator);
+  chances.pdm_fields = enabled(swarm_generator);
+  return chances;
+}
+
+// Returns what emitting the program for `program_seed` needs besides its
+// classes, which is also what its snapshot keeps.
+static SnapshotInfo program_info(unsigned long program_seed) {
+  SnapshotInfo info;
+  info.seed = program_seed;
+  info.gnu_dialect = gnu_dialect;
+  info.check_vptrs = check_vptrs;
+  info.swarm = swarm;
+  FeatureChances chances = feature_chances(program_seed);
+  if (swarm) {
+    for (const SwarmChance &swarm_chance : kSwarmChances)
+      info.swarm_chances.push_back(chances.*swarm_chance.chance);
+  }
+  info.pmf_fields = chances.pmf_fields;
+  info.pdm_fields = chances.pdm_fields;
+  return info;
+}
+
+// The files one program is written to.  An unsharded program is a single
+// file, which `header` and `main` both point to.  A sharded program puts the
+// classes and the harness declarations in the header, main() and the harness
+// definitions in the main file, and its tests in the shard files.
+struct ProgramFiles {
+  OutputBuffer *header;
+  OutputBuffer *main;
+  std::vector<OutputBuffer *> shards;
+  std::string header_name;
+};
+
+// Fills `candidates` with a random subset of [0, num_pbases), in random order,
+// where each class is included with probability `chance_of_base` percent.  This
+// is the distribution the default shuffle-and-roll selection draws from.
+static void sample_base_candidates(RandomStream &generator, int num_pbases,
+                                   int chance_of_base,
+                                   std::vector<int> &candidates) {
+  double chance = std::min(std::max(chance_of_base, 0), 100) / 100.0;
+  std::binomial_distribution<int> num_candidates_dist(num_pbases, chance);
+  int num_candidates = num_candidates_dist(generator);
+
+  // Floyd's algorithm draws distinct classes without touching the others.
+  candidates.clear();
+  std::unordered_set<int> chosen;
+  chosen.reserve(num_candidates);
+  for (int upper = num_pbases - num_candidates; upper < num_pbases; ++upper) {
+    std::uniform_int_distribution<int> candidate_dist(0, upper);
+    int candidate = candidate_dist(generator);
+    if (!chosen.insert(candidate).second) {
+      candidate = upper;
+      chosen.insert(candidate);
+    }
+    candidates.push_back(candidate);
+  }
+  std::shuffle(candidates.begin(), candidates.end(), generator);
+}
+
+// Appends to `candidates` a class from [0, num_pbases) that it does not hold
+// yet, drawn uniformly, or returns false if it holds them all.  `tried` is the
+// set of classes in `candidates`, and is filled on first use.
+static bool extend_base_candidates(RandomStream &generator, int num_pbases,
+                                   std::vector<int> &candidates,
+                                   std::unordered_set<int> &tried) {
+  if (candidates.size() >= static_cast<size_t>(num_pbases))
+    return false;
+  if (tried.empty())
+    tried.insert(candidates.begin(), candidates.end());
+  std::uniform_int_distribution<int> candidate_dist(0, num_pbases - 1);
+  int candidate;
+  do {
+    candidate = candidate_dist(generator);
+  } while (!tried.insert(candidate).second);
+  candidates.push_back(candidate);
+  return true;
+}
+
+static void emit_prologue(ProgramFiles &files, const SnapshotInfo &info) {
+  OutputBuffer &out = *files.header;
+  bool sharded = !files.shards.empty();
+  if (info.swarm) {
+    out << "// Swarm configuration for seed " << info.seed
+        << " (reproduce with --seed=" << info.seed << " --swarm):\n";
+    out << "//";
+    for (size_t chance_i = 0; chance_i < info.swarm_chances.size(); ++chance_i)
+      out << " --" << kSwarmChances[chance_i].name << '='
+          << info.swarm_chances[chance_i];
+    out << '\n';
+    out << "// PMF fields: " << (info.pmf_fields ? "on" : "off")
+        << ", PDM fields: " << (info.pdm_fields ? "on" : "off") << '\n';
   }
+  if (!check_vptrs) {
+    out << "#if defined(__clang__) || defined(__GNUC__)\n";
+    out << "typedef __SIZE_TYPE__ size_t;\n";
+    out << "#endif\n";
+    out << "extern \"C\" int printf(const char *, ...);\n";
+    out << "extern \"C\" void *memset(void *, int, size_t);\n";
+    out << "extern \"C\" void *malloc(size_t);\n";
+    out << "extern \"C\" void free(void *);\n";
+    out << "extern \"C\" void exit(int);\n";
+    out << (sharded ? "extern" : "static") << " char *buffer;\n";
+    out << "inline void *operator new(size_t, void *pv) { return pv; }\n";
+    if (expected_layout) {
+      out << (sharded ? "inline" : "static") << " void check_offset(const char *field_name, size_t offset, size_t expected_offset) {\n";
+      out << "\tif (offset != expected_offset)\n";
+      out << "\t\tprintf(\"MISMATCH offset(%s): %llu, expected %llu\\n\", field_name, (unsigned long long)offset, (unsigned long long)expected_offset);\n";
+      out << "}\n";
+    }
+  }
+}
 
-  generator.seed((unsigned long)seed);
+// Returns what the decisions at `site` for class `class_i` are drawn from.
+static RandomStream random_stream(GenerationContext &context,
+                                  bool counter_based, int class_i,
+                                  RandomSite site) {
+  if (!counter_based)
+    return RandomStream(context.generator);
+  return RandomStream(context.seed, class_i, site);
+}
+
+// Picks the class a type of kind `type` names, if it names one, from the
+// first `num_types` classes, the last of which is being generated.  A class
+// can only hold an earlier class by value, so the first class points to
+// itself instead.
+static int draw_type_class(RandomStream &random, size_t num_types,
+                           int &type) {
+  if (type < TypeKind_PClass)
+    return -1;
+  if (type == TypeKind_Class && num_types == 1)
+    type = TypeKind_PClass;
+  std::uniform_int_distribution<int> class_dist(
+      0, type == TypeKind_Class ? num_types - 2 : num_types - 1);
+  return class_dist(random);
+}
+
+// Generates the classes of a program into `context`.  If `stream_out` is set,
+// each class is also written to it as soon as it is complete.
+static void generate_classes(GenerationContext &context,
+                             OutputBuffer *stream_out) {
+  std::vector<Class *> &types = context.types;
+  bool counter_based = std::string(rng) == "philox";
 
   std::uniform_int_distribution<int> field_count_dist(min_num_fields,
                                                       max_num_fields);
@@ -50,184 +387,1154 @@ int main(int argc, const char *argv[]) {
   std::uniform_int_distribution<int> class_alignment_pow2(0, 13);
   std::uniform_int_distribution<int> class_packed_pow2(0, 4);
   std::uniform_int_distribution<int> class_vtordisp(0, 2);
+  // Every type drawn comes from one table, built once per program.
+  std::vector<int> type_weights;
+  for (const Option<int> *weight : kTypeKindWeights)
+    type_weights.push_back(*weight);
+  AliasTable type_dist(type_weights);
 
-  if (!check_vptrs) {
-    std::cout << "#if defined(__clang__) || defined(__GNUC__)\n";
-    std::cout << "typedef __SIZE_TYPE__ size_t;\n";
-    std::cout << "#endif\n";
-    std::cout << "extern \"C\" int printf(const char *, ...);\n";
-    std::cout << "extern \"C\" void *memset(void *, int, size_t);\n";
-    std::cout << "static char buffer[419430400];\n";
-    std::cout << "inline void *operator new(size_t, void *pv) { return pv; }\n";
-  }
-  auto shuffled_classes = new int[num_classes];
+  FeatureChances chances = feature_chances(context.seed);
+  std::vector<int> shuffled_classes(num_classes);
+  std::vector<int> base_candidates;
+  // Own methods have always inherited is_pure from the most recently
+  // generated override method; keep doing so to preserve existing programs.
+  bool last_override_is_pure = false;
+  bool tracking_coverage =
+      coverage_bias || !std::string(coverage_path).empty();
+  PhaseTimer timer(context.stats);
   for (int class_i = 0; class_i < num_classes; ++class_i) {
-    auto new_type = new Class(class_i);
-    if (int num_pbases = types.size()) {
+    RandomStream bases_random =
+        random_stream(context, counter_based, class_i, RandomSite_Bases);
+    RandomStream fields_random =
+        random_stream(context, counter_based, class_i, RandomSite_Fields);
+    RandomStream methods_random =
+        random_stream(context, counter_based, class_i, RandomSite_Methods);
+    RandomStream attributes_random =
+        random_stream(context, counter_based, class_i, RandomSite_Attributes);
+    RandomStream coverage_random =
+        random_stream(context, counter_based, class_i, RandomSite_Coverage);
+    // Nothing carries over from one class to the next with counter-based
+    // streams, so that a class only depends on its own draws.
+    if (counter_based)
+      last_override_is_pure = false;
+    Arena &class_arena = stream_out ? context.scratch_arena : context.arena;
+    auto new_type = class_arena.create<Class>(class_i, class_arena);
+    // With --coverage-bias, the layout features this class is steered
+    // toward, and those it has so far.  A wanted feature that is still
+    // missing turns the decisions that would add it into certainties; the
+    // random numbers drawn stay the same.
+    LayoutFeatureSet want =
+        coverage_bias ? coverage.pick_uncovered(coverage_random) : 0;
+    LayoutFeatureSet have = 0;
+    auto wants = [&want, &have](LayoutFeature feature) {
+      return ((want & ~have) & feature_bit(feature)) != 0;
+    };
+    auto roll = [&percent](RandomStream &random, int chance, bool force) {
+      return percent(random) <= (force ? 100 : chance);
+    };
+    auto wants_base = [&wants]() {
+      return wants(LayoutFeature_NonvirtualBase) ||
+             wants(LayoutFeature_VirtualBase) ||
+             wants(LayoutFeature_MultipleBases);
+    };
+    auto note_base = [&have, new_type](bool is_virtual) {
+      have |= feature_bit(is_virtual ? LayoutFeature_VirtualBase
+                                     : LayoutFeature_NonvirtualBase);
+      if (new_type->direct_bases.size() > 1)
+        have |= feature_bit(LayoutFeature_MultipleBases);
+    };
+    timer.start(GenerationPhase_Bases);
+    int num_pbases = types.size();
+    int chained_base = base_chain && num_pbases ? num_pbases - 1 : -1;
+    if (chained_base != -1) {
+      new_type->add_base(context, chained_base, false);
+      note_base(false);
+    }
+    if (num_pbases && fast_base_selection) {
+      sample_base_candidates(bases_random, num_pbases, chances.base,
+                             base_candidates);
+      // The default selection forces every remaining class to be rolled as
+      // a base while a base feature is wanted; here a wanted feature that
+      // the sample leaves missing draws further classes instead.
+      std::unordered_set<int> tried_bases;
+      for (size_t candidate_i = 0;
+           candidate_i < base_candidates.size() ||
+           (wants_base() && extend_base_candidates(bases_random, num_pbases,
+                                                   base_candidates,
+                                                   tried_bases));
+           ++candidate_i) {
+        int pbase = base_candidates[candidate_i];
+        if (pbase == chained_base)
+          continue;
+        if (!gnu_dialect && !new_type->is_viable_base(context, pbase)) {
+          if (context.stats)
+            ++context.stats->rejected_bases;
+          continue;
+        }
+
+        bool is_virtual = roll(bases_random, chances.vbase,
+                               wants(LayoutFeature_VirtualBase));
+        if (wants(LayoutFeature_NonvirtualBase) &&
+            !wants(LayoutFeature_VirtualBase))
+          is_virtual = false;
+        new_type->add_base(context, pbase, is_virtual);
+        note_base(is_virtual);
+      }
+    } else if (num_pbases) {
       // fill shuffled_classes with the range [0, num_pbases]
       for (int pbase_i = 0; pbase_i < num_pbases; ++pbase_i) {
         shuffled_classes[pbase_i] = pbase_i;
       }
       // randomize the order of which potential bases to inherit from
-      std::shuffle(shuffled_classes, shuffled_classes + num_pbases, generator);
+      std::shuffle(shuffled_classes.begin(),
+                   shuffled_classes.begin() + num_pbases, bases_random);
       for (int pbase_i = 0; pbase_i < num_pbases; ++pbase_i) {
-        if (percent(generator) > chance_of_base) {
+        if (!roll(bases_random, chances.base, wants_base())) {
           continue;
         }
 
         int pbase = shuffled_classes[pbase_i];
-        if (!gnu_dialect && !new_type->is_viable_base(pbase)) {
+        if (pbase == chained_base)
+          continue;
+        if (!gnu_dialect && !new_type->is_viable_base(context, pbase)) {
+          if (context.stats)
+            ++context.stats->rejected_bases;
           continue;
         }
 
-        bool is_virtual = percent(generator) <= chance_of_vbase;
-        new_type->add_base(pbase, is_virtual);
+        bool is_virtual = roll(bases_random, chances.vbase,
+                               wants(LayoutFeature_VirtualBase));
+        if (wants(LayoutFeature_NonvirtualBase) &&
+            !wants(LayoutFeature_VirtualBase))
+          is_virtual = false;
+        new_type->add_base(context, pbase, is_virtual);
+        note_base(is_virtual);
       }
     }
 
-    types.push_back(new_type);
-    int num_fields = field_count_dist(generator);
+    timer.start(GenerationPhase_Fields);
+    append_class(context, new_type);
+    int num_fields = field_count_dist(fields_random);
+    // Each wanted field feature gets a field of its own.
+    num_fields = std::max<int>(
+        num_fields, std::bitset<32>(want & kFieldLayoutFeatures).count());
+    new_type->fields.reserve(std::max(num_fields, 0));
     for (int field_i = 0; field_i < num_fields; ++field_i) {
-      std::uniform_int_distribution<int> field_type_dist(
-          TypeKind_Bool, types.empty() ? TypeKind_Double : TypeKind_Class);
-      int field_type = field_type_dist(generator);
-      int type_class = -1;
-      if (field_type >= TypeKind_PClass) {
-        if (field_type == TypeKind_Class && types.size() == 1)
-          field_type = TypeKind_PClass;
-        std::uniform_int_distribution<int> type_dist(
-            0,
-            field_type == TypeKind_Class ? types.size() - 2 : types.size() - 1);
-        type_class = type_dist(generator);
-      }
+      int field_type = type_dist(fields_random);
+      while (!chances.allows_field(field_type))
+        field_type = type_dist(fields_random);
+      bool wants_bitfield = wants(LayoutFeature_Bitfield) ||
+                            wants(LayoutFeature_AnonymousBitfield) ||
+                            wants(LayoutFeature_AlignedBitfield);
+      if (wants(LayoutFeature_PMFField))
+        field_type = TypeKind_PMF;
+      else if (wants(LayoutFeature_PDMField))
+        field_type = TypeKind_PDM;
+      else if (wants(LayoutFeature_ClassField) && types.size() > 1)
+        field_type = TypeKind_Class;
+      else if (wants_bitfield && field_type > TypeKind_LongLong)
+        field_type = TypeKind_Int;
+      int type_class =
+          draw_type_class(fields_random, types.size(), field_type);
       auto &field = new_type->add_field((TypeKind)field_type);
       field.set_type_class(type_class);
 
       if (field_type <= TypeKind_LongLong &&
-          percent(generator) <= chance_of_bitfield) {
-        int bitfield_width = field_array_elt_dist(generator);
+          roll(fields_random, chances.bitfield, wants_bitfield)) {
+        int bitfield_width = field_array_elt_dist(fields_random);
         field.set_bitfield_width(bitfield_width);
-        if (percent(generator) <= chance_of_anon_field) {
+        if (roll(fields_random, chances.anon_field,
+                 wants(LayoutFeature_AnonymousBitfield))) {
           field.set_anonymous();
         }
-      } else if (percent(generator) <= chance_of_array) {
+      } else if (roll(fields_random, chances.array,
+                      wants(LayoutFeature_Array))) {
         do {
-         field.add_array_dimension(field_array_elt_dist(generator) + 1);
-        } while (percent(generator) <= chance_of_array);
+         field.add_array_dimension(field_array_elt_dist(fields_random) + 1);
+        } while (percent(fields_random) <= chances.array);
       }
-      if (percent(generator) <= chance_of_field_aligned) {
+      bool wants_alignment =
+          wants(LayoutFeature_AlignedField) ||
+          (wants(LayoutFeature_AlignedBitfield) && field.bitfield_width > -1);
+      if (roll(fields_random, chances.field_aligned, wants_alignment)) {
         do {
-          int field_alignment = 1 << field_alignment_pow2(generator);
+          int field_alignment = 1 << field_alignment_pow2(fields_random);
           field.set_alignment(field_alignment, gnu_dialect);
-        } while (percent(generator) <= chance_of_field_aligned);
+        } while (percent(fields_random) <= chances.field_aligned);
       }
+      have |= field_layout_features(field);
     }
-    std::uniform_int_distribution<int> ret_type_dist(
-        TypeKind_Bool, types.empty() ? TypeKind_Double : TypeKind_Class);
-    if (percent(generator) <= chance_of_own_method) {
-      int ret_type = ret_type_dist(generator);
-      int ret_type_class = -1;
-      if (ret_type >= TypeKind_PClass) {
-        if (ret_type == TypeKind_Class && types.size() == 1)
-          ret_type = TypeKind_PClass;
-        std::uniform_int_distribution<int> ret_type_class_dist(
-            0,
-            ret_type == TypeKind_Class ? types.size() - 2 : types.size() - 1);
-        ret_type_class = ret_type_class_dist(generator);
-      }
+    timer.start(GenerationPhase_Methods);
+    if (roll(methods_random, chances.own_method,
+             wants(LayoutFeature_VirtualMethod))) {
+      int ret_type = type_dist(methods_random);
+      int ret_type_class =
+          draw_type_class(methods_random, types.size(), ret_type);
       Class::Method method;
-      method.name = new_type->get_class_name() + "Method";
+      method.name_class = class_i;
       method.ret_type = (TypeKind)ret_type;
       method.ret_type_class = ret_type_class;
       method.is_virtual = true;
+      method.is_pure = last_override_is_pure;
       method.arg_type = TypeKind_Bool;
       method.arg_type_class = -1;
       new_type->add_method(method);
+      have |= feature_bit(LayoutFeature_VirtualMethod);
+      if (method.is_pure)
+        have |= feature_bit(LayoutFeature_PureMethod);
     }
-    if (percent(generator) <= chance_of_override_method) {
-      int ret_type = ret_type_dist(generator);
-      int ret_type_class = -1;
-      if (ret_type >= TypeKind_PClass) {
-        if (ret_type == TypeKind_Class && types.size() == 1)
-          ret_type = TypeKind_PClass;
-        std::uniform_int_distribution<int> ret_type_class_dist(
-            0,
-            ret_type == TypeKind_Class ? types.size() - 2 : types.size() - 1);
-        ret_type_class = ret_type_class_dist(generator);
-      }
+    bool wants_virtual_override = wants(LayoutFeature_VirtualMethod) ||
+                                  wants(LayoutFeature_PureMethod);
+    if (roll(methods_random, chances.override_method,
+             wants_virtual_override)) {
+      int ret_type = type_dist(methods_random);
+      int ret_type_class =
+          draw_type_class(methods_random, types.size(), ret_type);
       Class::Method method;
-      method.name = "OverrideMethod";
+      method.name_class = -1;
       method.ret_type = (TypeKind)ret_type;
       method.ret_type_class = ret_type_class;
-      method.is_virtual = percent(generator) <= chance_of_virt_override;
-      method.is_pure = method.is_virtual && percent(generator) <= chance_of_pure_virt;
-      int arg_type = ret_type_dist(generator);
-      int arg_type_class = -1;
-      if (arg_type >= TypeKind_PClass) {
-        if (arg_type == TypeKind_Class && types.size() == 1)
-          arg_type = TypeKind_PClass;
-        std::uniform_int_distribution<int> arg_type_class_dist(
-            0,
-            arg_type == TypeKind_Class ? types.size() - 2 : types.size() - 1);
-        arg_type_class = arg_type_class_dist(generator);
-      }
+      method.is_virtual =
+          roll(methods_random, chances.virt_override, wants_virtual_override);
+      method.is_pure =
+          method.is_virtual &&
+          roll(methods_random, chances.pure_virt,
+               wants(LayoutFeature_PureMethod));
+      last_override_is_pure = method.is_pure;
+      int arg_type = type_dist(methods_random);
+      int arg_type_class =
+          draw_type_class(methods_random, types.size(), arg_type);
       method.arg_type = (TypeKind)arg_type;
       method.arg_type_class = arg_type_class;
       new_type->add_method(method);
     }
-    if (percent(generator) <= chance_of_class_packed) {
-      int packed = 1 << class_packed_pow2(generator);
+    timer.start(GenerationPhase_Attributes);
+    if (roll(attributes_random, chances.class_packed,
+             wants(LayoutFeature_Packed))) {
+      int packed = 1 << class_packed_pow2(attributes_random);
       new_type->set_packed(packed);
     }
     new_type->set_dllexport(check_vptrs);
-    new_type->set_ctor(percent(generator) <= chance_of_ctor);
-    if (percent(generator) <= chance_of_class_vtordisp) {
-      int vtordisp = class_vtordisp(generator);
+    new_type->set_ctor(percent(attributes_random) <= chance_of_ctor);
+    if (roll(attributes_random, chances.class_vtordisp,
+             wants(LayoutFeature_Vtordisp))) {
+      int vtordisp = class_vtordisp(attributes_random);
       new_type->set_vtordisp(vtordisp);
     }
-    if (percent(generator) <= chance_of_class_aligned) {
-      int align = 1 << class_alignment_pow2(generator);
+    if (roll(attributes_random, chances.class_aligned,
+             wants(LayoutFeature_Aligned))) {
+      int align = 1 << class_alignment_pow2(attributes_random);
       new_type->set_alignment(align, gnu_dialect);
     }
+
+    if (tracking_coverage)
+      coverage.record(class_layout_features(*new_type));
+    if (context.stats)
+      context.stats->count_class(*new_type);
+
+    if (!std::string(dedup_index).empty())
+      update_layout_hashes(context);
+
+    if (stream_out) {
+      timer.start(GenerationPhase_Emission);
+      *stream_out << in_context(context, *new_type);
+      context.base_closures.back() = new_type->summarize(context.arena);
+      types.back() = nullptr;
+      context.scratch_arena.reset();
+    }
   }
+  timer.stop();
 
-  for (int class_i = 0; class_i < num_classes; ++class_i)
-    std::cout << *types[class_i];
+  if (context.stats) {
+    ++context.stats->programs;
+    uint64_t arena_bytes = context.arena.bytes_reserved() +
+                           context.scratch_arena.bytes_reserved();
+    context.stats->peak_arena_bytes =
+        std::max(context.stats->peak_arena_bytes, arena_bytes);
+  }
+}
 
-  if (!check_vptrs) {
-    std::cout << "static void test_layout(const char *class_name, size_t size_of_class, size_t align_of_class) {\n";
+// The order main() tests the classes in.
+static void shuffle_tests(GenerationContext &context,
+                          std::vector<int> &test_order) {
+  // fill test_order with the range [0, num_classes]
+  test_order.resize(context.types.size());
+  for (size_t class_i = 0; class_i < test_order.size(); ++class_i) {
+    test_order[class_i] = class_i;
+  }
+  // randomize the order in which the classes are tested
+  RandomStream random = random_stream(context, std::string(rng) == "philox",
+                                      0, RandomSite_TestOrder);
+  std::shuffle(test_order.begin(), test_order.end(), random);
+}
+
+// Writes static_asserts that check the classes in `test_order` against
+// `captured_layouts` in place of the harness.
+static void emit_static_asserts(OutputBuffer &out,
+                                const std::vector<int> &test_order) {
+  out << "#if defined(__clang__) || defined(__GNUC__)\n";
+  out << "#pragma GCC diagnostic ignored \"-Winvalid-offsetof\"\n";
+  out << "#define field_offset(Class, field) __builtin_offsetof(Class, field)\n";
+  out << "#else\n";
+  out << "#define field_offset(Class, field) ((size_t)&reinterpret_cast<const volatile char &>(((Class *)0)->field))\n";
+  out << "#endif\n";
+  for (int class_i : test_order) {
+    std::string name = "ClassName" + std::to_string(class_i);
+    auto captured = captured_layouts.find(name);
+    if (captured == captured_layouts.end()) {
+      out << "// No captured layout for " << name << ".\n";
+      continue;
+    }
+    const CapturedLayout &layout = captured->second;
+    if (layout.has_size)
+      out << "static_assert(sizeof(" << name << ") == " << layout.size
+          << ", \"sizeof(" << name << ")\");\n";
+    if (layout.has_alignment)
+      out << "static_assert(__alignof(" << name << ") == " << layout.alignment
+          << ", \"__alignof(" << name << ")\");\n";
+    for (const auto &field : layout.field_offsets)
+      out << "static_assert(field_offset(" << name << ", " << field.first
+          << ") == " << field.second << ", \"offset(" << field.first
+          << ")\");\n";
+  }
+  out << "int main() { return 0; }\n";
+}
+
+// Writes everything that follows the prologue: the classes, unless they were
+// streamed, and the harness that tests them in `test_order`.
+static void emit_program(GenerationContext &context, ProgramFiles &files,
+                         const std::vector<int> &test_order) {
+  std::vector<Class *> &types = context.types;
+  OutputBuffer &out = *files.header;
+  OutputBuffer &main_out = *files.main;
+  bool sharded = !files.shards.empty();
+  int num_types = types.size();
+  PhaseTimer timer(context.stats);
+  timer.start(GenerationPhase_Emission);
+
+  std::unique_ptr<LayoutEngine> layout_engine;
+  if (expected_layout && !check_vptrs) {
+    layout_engine.reset(new LayoutEngine(
+        context, gnu_dialect ? LayoutABI_Itanium : LayoutABI_Microsoft));
+    context.expected_layouts = layout_engine.get();
+  }
+
+  if (!stream_classes) {
+    for (int class_i = 0; class_i < num_types; ++class_i)
+      out << in_context(context, *types[class_i]);
+  }
+
+  if (!std::string(static_asserts_path).empty()) {
+    emit_static_asserts(main_out, test_order);
+  } else if (!check_vptrs) {
+    // In a sharded program the harness state is shared by every file, so it
+    // is declared in the header and defined once in the main file.
+    int num_shards = files.shards.size();
+    const char *linkage = sharded ? "" : "static ";
+    const char *test_layout_signature =
+        expected_layout
+            ? "void test_layout(const char *class_name, size_t size_of_class, size_t align_of_class, size_t expected_size, size_t expected_align)"
+            : "void test_layout(const char *class_name, size_t size_of_class, size_t align_of_class)";
+    if (sharded) {
+      out << test_layout_signature << ";\n";
+      main_out << "#include \"" << files.header_name << "\"\n";
+      main_out << "char *buffer;\n";
+      main_out << "char *buffer_storage;\n";
+      main_out << "size_t buffer_capacity;\n";
+      main_out << "int first_class = 0;\n";
+      main_out << "int last_class = 0x7fffffff;\n";
+    }
+    main_out << linkage << test_layout_signature << " {\n";
     if (gnu_dialect) {
-      std::cout << "\tprintf(\"     sizeof(%s): %zu\\n\", class_name, size_of_class);\n";
-      std::cout << "\tprintf(\"__alignof__(%s): %zu\\n\", class_name, align_of_class);\n";
+      main_out << "\tprintf(\"     sizeof(%s): %zu\\n\", class_name, size_of_class);\n";
+      main_out << "\tprintf(\"__alignof__(%s): %zu\\n\", class_name, align_of_class);\n";
+    } else {
+      main_out << "\tprintf(\"   sizeof(%s): %Iu\\n\", class_name, size_of_class);\n";
+      main_out << "\tprintf(\"__alignof(%s): %Iu\\n\", class_name, align_of_class);\n";
+    }
+    if (expected_layout) {
+      main_out << "\tif (size_of_class != expected_size)\n";
+      main_out << "\t\tprintf(\"MISMATCH sizeof(%s): %llu, expected %llu\\n\", class_name, (unsigned long long)size_of_class, (unsigned long long)expected_size);\n";
+      main_out << "\tif (align_of_class != expected_align)\n";
+      main_out << "\t\tprintf(\"MISMATCH __alignof(%s): %llu, expected %llu\\n\", class_name, (unsigned long long)align_of_class, (unsigned long long)expected_align);\n";
+    }
+    main_out << "}\n";
+
+    // The buffer grows to fit the largest class tested so far, and only the
+    // bytes of the class under test are poisoned before constructing it.
+    // Without the memory for a class, the program stops where difftest and
+    // layoutdiff can tell it did.
+    if (sharded) {
+      out << "extern char *buffer_storage;\n";
+      out << "extern size_t buffer_capacity;\n";
+    } else {
+      out << "static char *buffer_storage;\n";
+      out << "static size_t buffer_capacity;\n";
+    }
+    out << "template <typename Class>\n";
+    out << "static void init_mem() {\n";
+    out << "\tsize_t needed = sizeof(Class) + __alignof(Class);\n";
+    out << "\tif (needed > buffer_capacity) {\n";
+    out << "\t\tfree(buffer_storage);\n";
+    out << "\t\tbuffer_storage = (char *)malloc(needed);\n";
+    out << "\t\tif (!buffer_storage) {\n";
+    out << "\t\t\tprintf(\"" << kOutOfMemoryLine
+        << ": %llu bytes\\n\", (unsigned long long)needed);\n";
+    out << "\t\t\texit(" << kOutOfMemoryStatus << ");\n";
+    out << "\t\t}\n";
+    out << "\t\tbuffer_capacity = needed;\n";
+    out << "\t}\n";
+    out << "\tbuffer = (char *)(((size_t)buffer_storage + __alignof(Class) - 1) & ~(size_t)(__alignof(Class) - 1));\n";
+    out << "\tmemset(buffer, 0xcc, sizeof(Class));\n";
+    out << "\tnew (buffer) Class;\n";
+    out << "}\n";
+
+    // Running the program with an argument of the form N or N:M only tests
+    // the classes with those indices.
+    if (sharded) {
+      out << "extern int first_class;\n";
+      out << "extern int last_class;\n";
     } else {
-      std::cout << "\tprintf(\"   sizeof(%s): %Iu\\n\", class_name, size_of_class);\n";
-      std::cout << "\tprintf(\"__alignof(%s): %Iu\\n\", class_name, align_of_class);\n";
+      out << "static int first_class = 0;\n";
+      out << "static int last_class = 0x7fffffff;\n";
+    }
+    main_out << "static int parse_class_index(const char *&str) {\n";
+    main_out << "\tint index = 0;\n";
+    main_out << "\twhile (*str >= '0' && *str <= '9')\n";
+    main_out << "\t\tindex = index * 10 + (*str++ - '0');\n";
+    main_out << "\treturn index;\n";
+    main_out << "}\n";
+
+    if (expected_layout)
+      out << "#define test(Class, index, size, align) if (index >= first_class && index <= last_class) init_mem<Class>(), test_layout(#Class, sizeof(Class), __alignof(Class), size, align)\n";
+    else
+      out << "#define test(Class, index) if (index >= first_class && index <= last_class) init_mem<Class>(), test_layout(#Class, sizeof(Class), __alignof(Class))\n";
+
+    for (int shard_i = 0; shard_i < num_shards; ++shard_i)
+      main_out << "void run_shard" << shard_i << "();\n";
+    main_out << "int main(int argc, char **argv) {\n";
+    main_out << "\tif (argc > 1) {\n";
+    main_out << "\t\tconst char *arg = argv[1];\n";
+    main_out << "\t\tfirst_class = last_class = parse_class_index(arg);\n";
+    main_out << "\t\tif (*arg == ':') {\n";
+    main_out << "\t\t\t++arg;\n";
+    main_out << "\t\t\tlast_class = parse_class_index(arg);\n";
+    main_out << "\t\t}\n";
+    main_out << "\t}\n";
+
+
+    auto emit_tests = [&](OutputBuffer &test_out, int begin, int end) {
+      // Streamed classes are gone by now; only their indices are left.
+      for (int test_i = begin; test_i < end; ++test_i) {
+        int class_i = test_order[test_i];
+        test_out << "\ttest(" << ClassName{class_i} << ", " << class_i;
+        if (layout_engine) {
+          const ClassLayout &layout = layout_engine->get_layout(class_i);
+          test_out << ", " << layout.size << ", " << layout.alignment;
+        }
+        test_out << ");\n";
+      }
+    };
+    if (!sharded)
+      emit_tests(main_out, 0, test_order.size());
+    int num_tests = test_order.size();
+    // Each shard runs a contiguous slice of the shuffled tests and main()
+    // runs the shards in order, so the tests run in the same order as in an
+    // unsharded program.
+    for (int shard_i = 0; shard_i < num_shards; ++shard_i) {
+      OutputBuffer &shard_out = *files.shards[shard_i];
+      shard_out << "#include \"" << files.header_name << "\"\n";
+      shard_out << "void run_shard" << shard_i << "() {\n";
+      emit_tests(shard_out, (long long)shard_i * num_tests / num_shards,
+                 (long long)(shard_i + 1) * num_tests / num_shards);
+      shard_out << "}\n";
+      main_out << "\trun_shard" << shard_i << "();\n";
+    }
+
+    main_out << "}\n";
+  }
+
+  context.expected_layouts = nullptr;
+  if (context.stats) {
+    uint64_t bytes = out.bytes_written();
+    if (&main_out != &out)
+      bytes += main_out.bytes_written();
+    for (OutputBuffer *shard_out : files.shards)
+      bytes += shard_out->bytes_written();
+    context.stats->bytes_emitted += bytes;
+  }
+}
+
+static void generate_program(GenerationContext &context, ProgramFiles &files) {
+  emit_prologue(files, program_info(context.seed));
+  generate_classes(context, stream_classes ? files.header : nullptr);
+  std::vector<int> test_order;
+  if (!check_vptrs)
+    shuffle_tests(context, test_order);
+  emit_program(context, files, test_order);
+}
+
+// With --dedup-index, narrows `test_order` to the classes whose layouts
+// have not been tested yet.  Returns false if none is left.
+static bool select_untested(GenerationContext &context,
+                            std::vector<int> &test_order) {
+  if (std::string(dedup_index).empty())
+    return true;
+  update_layout_hashes(context);
+  layout_index.select_untested(context, test_order);
+  return !test_order.empty();
+}
+
+// Writes the program for `program_seed` to --out-dir: <seed>.cpp, or with
+// --shards, <seed>.h, <seed>.main.cpp, <seed>.shard<N>.cpp and a <seed>.mk
+// makefile that builds the executable <seed>.  With --dedup-index, nothing
+// is written for a program that tests no new layout.
+static bool write_program(GenerationContext &context,
+                          unsigned long program_seed,
+                          const char *program_name) {
+  bool deduplicating = !std::string(dedup_index).empty();
+  std::vector<int> test_order;
+  if (deduplicating) {
+    generate_classes(context, nullptr);
+    shuffle_tests(context, test_order);
+    if (!select_untested(context, test_order))
+      return true;
+  }
+
+  std::string prefix =
+      std::string(out_dir) + '/' + std::to_string(program_seed);
+  std::string name = std::to_string(program_seed);
+  int num_shards = std::max(int(shards), 0);
+
+  std::vector<std::string> paths;
+  if (num_shards == 0) {
+    paths.push_back(prefix + ".cpp");
+  } else {
+    paths.push_back(prefix + ".h");
+    paths.push_back(prefix + ".main.cpp");
+    for (int shard_i = 0; shard_i < num_shards; ++shard_i)
+      paths.push_back(prefix + ".shard" + std::to_string(shard_i) + ".cpp");
+  }
+  std::vector<std::unique_ptr<std::ofstream>> streams;
+  std::vector<std::unique_ptr<OutputBuffer>> buffers;
+  for (const std::string &path : paths) {
+    streams.emplace_back(new std::ofstream(path));
+    if (!*streams.back()) {
+      std::cerr << program_name << ": could not open " << path << '\n';
+      return false;
+    }
+    buffers.emplace_back(new OutputBuffer(*streams.back()));
+  }
+
+  ProgramFiles files;
+  files.header = buffers[0].get();
+  files.main = buffers[num_shards == 0 ? 0 : 1].get();
+  for (int shard_i = 0; shard_i < num_shards; ++shard_i)
+    files.shards.push_back(buffers[shard_i + 2].get());
+  files.header_name = name + ".h";
+  if (deduplicating) {
+    emit_prologue(files, program_info(program_seed));
+    emit_program(context, files, test_order);
+  } else {
+    generate_program(context, files);
+  }
+  if (num_shards == 0)
+    return true;
+
+  std::string makefile_path = prefix + ".mk";
+  std::ofstream makefile(makefile_path);
+  if (!makefile) {
+    std::cerr << program_name << ": could not open " << makefile_path << '\n';
+    return false;
+  }
+  makefile << "# Build with: make -f " << name << ".mk -j" << num_shards + 1
+           << '\n';
+  makefile << "OBJS = " << name << ".main.o";
+  for (int shard_i = 0; shard_i < num_shards; ++shard_i)
+    makefile << ' ' << name << ".shard" << shard_i << ".o";
+  makefile << '\n';
+  makefile << name << ": $(OBJS)\n";
+  makefile << "\t$(CXX) $(CXXFLAGS) $(LDFLAGS) -o $@ $(OBJS)\n";
+  makefile << "%.o: %.cpp " << name << ".h\n";
+  makefile << "\t$(CXX) $(CXXFLAGS) -c -o $@ $<\n";
+  makefile << "clean:\n";
+  makefile << "\trm -f " << name << " $(OBJS)\n";
+  makefile << ".PHONY: clean\n";
+  return true;
+}
+
+// Writes the model in `context` to <seed>.snap in --out-dir.
+static bool save_snapshot(const GenerationContext &context,
+                          const std::vector<int> &test_order,
+                          const SnapshotInfo &info, const char *program_name) {
+  std::string path =
+      std::string(out_dir) + '/' + std::to_string(info.seed) + ".snap";
+  if (!write_snapshot(path, context, test_order, info)) {
+    std::cerr << program_name << ": could not write " << path << '\n';
+    return false;
+  }
+  return true;
+}
+
+static int run_batch(const char *program_name) {
+  unsigned long first_seed, last_seed;
+  if (!parse_seed_range(seed_range, first_seed, last_seed)) {
+    std::cerr << program_name << ": malformed seed range '"
+              << std::string(seed_range) << "'\n";
+    return EXIT_FAILURE;
+  }
+
+  int num_jobs = job_count(jobs);
+
+  // Seeds are handed out one at a time so that slow programs do not leave
+  // the other workers idle.
+  std::atomic<unsigned long> next_seed(first_seed);
+  std::atomic<bool> failed(false);
+  std::vector<GenerationStats> worker_stats(num_jobs);
+  auto worker = [&](int job_i) {
+    // Reused for every seed this worker takes, so that after the first few
+    // programs generation no longer allocates.
+    GenerationContext context(0);
+    if (stats_for_run())
+      context.stats = &worker_stats[job_i];
+    std::vector<int> test_order;
+    for (;;) {
+      unsigned long job_seed = next_seed++;
+      if (job_seed > last_seed || job_seed < first_seed || failed)
+        return;
+      context.reset(job_seed);
+      bool written;
+      if (write_snapshots) {
+        generate_classes(context, nullptr);
+        test_order.clear();
+        if (!check_vptrs)
+          shuffle_tests(context, test_order);
+        written = !select_untested(context, test_order) ||
+                  save_snapshot(context, test_order, program_info(job_seed),
+                                program_name);
+      } else {
+        written = write_program(context, job_seed, program_name);
+      }
+      if (!written) {
+        failed = true;
+        return;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int job_i = 0; job_i < num_jobs; ++job_i)
+    workers.emplace_back(worker, job_i);
+  for (auto &thread : workers)
+    thread.join();
+  for (const GenerationStats &stats : worker_stats)
+    run_stats.merge(stats);
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Builds the classes of the program for --seed, or reads them from
+// --from-snapshot, and the order to test them in, narrowed to --slice and
+// --dedup-index if they are set.  `info` is set to what emitting it needs.
+static bool generate_model(std::unique_ptr<GenerationContext> &context,
+                           std::vector<int> &test_order, SnapshotInfo &info,
+                           const char *program_name) {
+  if (!std::string(from_snapshot).empty()) {
+    std::string error;
+    if (!read_snapshot(from_snapshot, *context, test_order, info, error)) {
+      std::cerr << program_name << ": " << error << '\n';
+      return false;
+    }
+    if (info.swarm && info.swarm_chances.size() !=
+                          sizeof(kSwarmChances) / sizeof(kSwarmChances[0])) {
+      std::cerr << program_name << ": " << std::string(from_snapshot)
+                << " has " << info.swarm_chances.size()
+                << " swarm chances, not one per swarm option\n";
+      return false;
+    }
+    // The snapshot decides how its program is spelled and tested.
+    seed = info.seed;
+    gnu_dialect = info.gnu_dialect;
+    check_vptrs = info.check_vptrs;
+  } else {
+    info = program_info(seed);
+    generate_classes(*context, nullptr);
+    if (!check_vptrs)
+      shuffle_tests(*context, test_order);
+  }
+
+  if (slice >= 0) {
+    if (slice >= (int)context->types.size()) {
+      std::cerr << program_name << ": --slice must name one of the "
+                << context->types.size() << " classes\n";
+      return false;
     }
-    std::cout << "}\n";
+    std::unique_ptr<GenerationContext> sliced(new GenerationContext(0));
+    slice_program(*context, slice, *sliced, test_order);
+    context = std::move(sliced);
+  }
+  select_untested(*context, test_order);
+  return true;
+}
+
+// Writes a program built by generate_model: its snapshot with --snapshot,
+// otherwise the program itself to stdout.
+static bool write_model(GenerationContext &context,
+                        const std::vector<int> &test_order,
+                        const SnapshotInfo &info, const char *program_name) {
+  if (write_snapshots)
+    return save_snapshot(context, test_order, info, program_name);
+  OutputBuffer buffer(std::cout);
+  ProgramFiles files;
+  files.header = files.main = &buffer;
+  emit_prologue(files, info);
+  emit_program(context, files, test_order);
+  return true;
+}
+
+static int run_reduce(const char *program_name) {
+  int num_jobs = job_count(jobs);
+
+  std::unique_ptr<GenerationContext> context(new GenerationContext(seed));
+  context->stats = stats_for_run();
+  std::vector<int> test_order;
+  SnapshotInfo info;
+  if (!generate_model(context, test_order, info, program_name))
+    return EXIT_FAILURE;
+
+  std::string command = reduce_command;
+  auto candidate_path = [](int slot) {
+    return std::string(out_dir) + '/' + std::to_string(seed) + ".reduce" +
+           std::to_string(slot) + ".cpp";
+  };
+  auto is_interesting = [&](GenerationContext &candidate,
+                            const std::vector<int> &candidate_order,
+                            int slot) {
+    std::string path = candidate_path(slot);
+    {
+      std::ofstream file(path);
+      if (!file)
+        return false;
+      OutputBuffer buffer(file);
+      ProgramFiles files;
+      files.header = files.main = &buffer;
+      emit_prologue(files, info);
+      emit_program(candidate, files, candidate_order);
+    }
+    return run_command(command + ' ' + shell_quote(path)) == 0;
+  };
+
+  if (!is_interesting(*context, test_order, 0)) {
+    std::cerr << program_name << ": the program for seed " << seed
+              << " is not interesting to begin with\n";
+    std::remove(candidate_path(0).c_str());
+    return EXIT_FAILURE;
+  }
+  reduce_program(context, test_order, num_jobs, is_interesting);
+  for (int slot = 0; slot < num_jobs; ++slot)
+    std::remove(candidate_path(slot).c_str());
 
-    std::cout << "template <typename Class>\n";
-    std::cout << "static void init_mem() {\n";
-    std::cout << "\tmemset(buffer, 0xcc, sizeof(buffer));\n";
-    std::cout << "\tnew (buffer) Class;\n";
-    std::cout << "}\n";
+  return write_model(*context, test_order, info, program_name) ? EXIT_SUCCESS
+                                                               : EXIT_FAILURE;
+}
 
-    std::cout << "#define test(Class) init_mem<Class>(), test_layout(#Class, sizeof(Class), __alignof(Class))\n";
+// Checks that the options go together.  Returns false and explains why in
+// `error` if they do not.
+static bool check_options(std::string &error) {
+  if (num_classes < 0) {
+    error = "--num-classes cannot be negative";
+    return false;
+  }
+  if (min_num_fields < 0 || min_num_fields > max_num_fields) {
+    error = "--min-num-fields must be between 0 and --max-num-fields";
+    return false;
+  }
+  if (avg_num_array_elements <= 0) {
+    error = "--avg-num-array-elements must be positive";
+    return false;
+  }
+  if (chance_of_ctor < 0) {
+    error = "--chance-of-ctor cannot be negative";
+    return false;
+  }
+  for (const SwarmChance &chance : kSwarmChances) {
+    if (chance.option < 0) {
+      error = std::string("--") + chance.name + " cannot be negative";
+      return false;
+    }
+  }
 
-    std::cout << "int main() {\n";
+  if (!std::string(static_asserts_path).empty() &&
+      (check_vptrs || expected_layout || shards > 0)) {
+    // Those programs have no layout harness to replace, or one of their own.
+    error = "--static-asserts cannot be used with --check-vptrs, "
+            "--expected-layout or --shards";
+    return false;
+  }
 
+  if (std::string(rng) != "mt19937" && std::string(rng) != "philox") {
+    error = "--rng must be mt19937 or philox";
+    return false;
+  }
 
-    // fill shuffled_classes with the range [0, num_pbases]
-    for (int class_i = 0; class_i < num_classes; ++class_i) {
-      shuffled_classes[class_i] = class_i;
+  long long total_type_weight = 0, field_type_weight = 0;
+  for (int kind = TypeKind_Bool; kind <= TypeKind_Class; ++kind) {
+    int weight = *kTypeKindWeights[kind];
+    if (weight < 0) {
+      error = "type weights cannot be negative";
+      return false;
     }
-    // randomize the order of which potential bases to inherit from
-    std::shuffle(shuffled_classes, shuffled_classes + num_classes, generator);
-    for (int class_i = 0; class_i < num_classes; ++class_i) {
-      std::cout << "\ttest(" << types[shuffled_classes[class_i]]->get_class_name() << ");\n";
+    total_type_weight += weight;
+    if (kind != TypeKind_PMF && kind != TypeKind_PDM)
+      field_type_weight += weight;
+  }
+  if (total_type_weight == 0) {
+    error = "at least one type weight must be positive";
+    return false;
+  }
+  if (swarm && field_type_weight == 0) {
+    // Swarm programs may leave out PMF and PDM fields.
+    error = "--swarm needs a positive weight for a type other than PMF and "
+            "PDM";
+    return false;
+  }
+
+  if (stream_classes && expected_layout) {
+    // The layout engine needs the fields and methods of every class.
+    error = "--stream cannot be used with --expected-layout";
+    return false;
+  }
+
+  if (shards > 0 && check_vptrs) {
+    // --check-vptrs programs have no tests to shard.
+    error = "--shards cannot be used with --check-vptrs";
+    return false;
+  }
+
+  bool reduce = !std::string(reduce_command).empty();
+  bool loading = !std::string(from_snapshot).empty();
+  if ((reduce || slice >= 0 || loading) &&
+      (stream_classes || shards > 0 || !std::string(seed_range).empty())) {
+    // These rebuild one program from its whole model.
+    error = "--reduce, --slice and --from-snapshot cannot be used with "
+            "--stream, --shards or --seed-range";
+    return false;
+  }
+
+  if (!std::string(static_asserts_path).empty() && (reduce || slice >= 0)) {
+    // Both renumber the classes, but the captured layouts go by the names
+    // the classes had in the whole program.
+    error = "--static-asserts cannot be used with --reduce or --slice";
+    return false;
+  }
+
+  if (write_snapshots && (stream_classes || shards > 0)) {
+    error = "--snapshot cannot be used with --stream or --shards";
+    return false;
+  }
+
+  bool deduplicating = !std::string(dedup_index).empty();
+  if (deduplicating && (stream_classes || check_vptrs || reduce)) {
+    // Skipping a program means generating it before writing any of it, and
+    // --check-vptrs programs have no tests to skip.
+    error = "--dedup-index cannot be used with --stream, --check-vptrs or "
+            "--reduce";
+    return false;
+  }
+
+  if (serve && (reduce || slice >= 0 || loading || write_snapshots ||
+                deduplicating || shards > 0 ||
+                !std::string(seed_range).empty())) {
+    // A server writes one whole program per request.
+    error = "--serve cannot be used with --reduce, --slice, --from-snapshot, "
+            "--snapshot, --dedup-index, --shards or --seed-range";
+    return false;
+  }
+  return true;
+}
+
+// Options a request to the server cannot override: they set the server up,
+// or the request already says what they would.
+static const char *const kServerOnlyOptions[] = {
+    "coverage-map", "dedup-index", "from-snapshot", "help",
+    "jobs",         "out-dir",     "reduce",        "seed",
+    "seed-range",   "serve",       "shards",        "slice",
+    "snapshot",     "socket",      "static-asserts", "stats",
+};
+
+// Writes `contents` to the file `output`, or to the POSIX shared memory
+// object <name> if `output` is shm:<name>.
+static bool write_output(const std::string &output,
+                         const std::string &contents, std::string &error) {
+  int fd;
+  if (output.compare(0, 4, "shm:") == 0)
+    fd = shm_open(output.c_str() + 4, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  else
+    fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd == -1) {
+    error = "could not open " + output;
+    return false;
+  }
+  const char *data = contents.data();
+  size_t size = contents.size();
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written <= 0) {
+      if (written == -1 && errno == EINTR)
+        continue;
+      close(fd);
+      error = "could not write " + output;
+      return false;
     }
+    data += written;
+    size -= written;
+  }
+  close(fd);
+  return true;
+}
 
-    std::cout << "}\n";
+// Handles one request, "<seed> <output> [--option=value ...]": writes the
+// program for <seed>, with the options overridden for this request only, to
+// <output> as write_output() does.  Returns the response, "ok <bytes>
+// <microseconds>" or "error <reason>".
+static std::string serve_request(const std::string &request,
+                                 GenerationContext &context) {
+  std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  std::istringstream words(request);
+  std::string seed_word, output;
+  if (!(words >> seed_word >> output))
+    return "error expected <seed> <output> [--option=value ...]";
+  unsigned long request_seed;
+  try {
+    size_t pos;
+    request_seed = std::stoul(seed_word, &pos);
+    if (pos != seed_word.size())
+      throw std::invalid_argument(seed_word);
+  } catch (...) {
+    return "error malformed seed '" + seed_word + "'";
   }
 
+  std::string word, error;
+  while (words >> word) {
+    std::string name = word.substr(0, word.find('='));
+    for (const char *server_only : kServerOnlyOptions) {
+      if (name == std::string("--") + server_only)
+        error = name + " cannot be set by a request";
+    }
+    if (error.empty())
+      set_option(word, error);
+    if (!error.empty()) {
+      restore_options();
+      return "error " + error;
+    }
+  }
+  if (!check_options(error)) {
+    restore_options();
+    return "error " + error;
+  }
+
+  seed = request_seed;
+  context.reset(request_seed);
+  std::ostringstream program;
+  {
+    OutputBuffer buffer(program);
+    ProgramFiles files;
+    files.header = files.main = &buffer;
+    try {
+      generate_program(context, files);
+    } catch (const std::exception &exception) {
+      // Such as running out of memory for a huge program; the server keeps
+      // answering the requests after it.
+      restore_options();
+      return std::string("error generating the program: ") +
+             exception.what();
+    }
+  }
+  restore_options();
+  std::string contents = program.str();
+  if (!write_output(output, contents, error))
+    return "error " + error;
+  std::chrono::microseconds elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start_time);
+  return "ok " + std::to_string(contents.size()) + ' ' +
+         std::to_string(elapsed.count());
+}
+
+// Answers the requests read from `in_fd` on `out_fd`, one line each, until
+// the input ends or a request is "quit".  Returns false after "quit".
+static bool serve_connection(int in_fd, int out_fd,
+                             GenerationContext &context) {
+  std::string pending;
+  char chunk[4096];
+  for (;;) {
+    size_t newline;
+    while ((newline = pending.find('\n')) != std::string::npos) {
+      std::string request = pending.substr(0, newline);
+      pending.erase(0, newline + 1);
+      if (!request.empty() && request.back() == '\r')
+        request.pop_back();
+      if (request.empty())
+        continue;
+      if (request == "quit")
+        return false;
+      std::string response = serve_request(request, context) + '\n';
+      const char *data = response.data();
+      size_t size = response.size();
+      while (size > 0) {
+        ssize_t written = write(out_fd, data, size);
+        if (written <= 0) {
+          if (written == -1 && errno == EINTR)
+            continue;
+          return true;
+        }
+        data += written;
+        size -= written;
+      }
+    }
+    ssize_t got = read(in_fd, chunk, sizeof(chunk));
+    if (got == -1 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return true;
+    pending.append(chunk, got);
+  }
+}
+
+// Stays resident and answers requests from stdin, or from every connection
+// to --socket in turn, until stdin ends or a request is "quit".
+static int run_server(const char *program_name) {
+  // Every request starts from the options the server was started with.
+  save_options();
+  GenerationContext context(0);
+  context.stats = stats_for_run();
+  std::string path = socket_path;
+  if (path.empty()) {
+    serve_connection(STDIN_FILENO, STDOUT_FILENO, context);
+    return EXIT_SUCCESS;
+  }
+
+  int listener = listen_unix_socket(path);
+  if (listener == -1) {
+    std::cerr << program_name << ": could not listen on " << path << '\n';
+    return EXIT_FAILURE;
+  }
+  for (;;) {
+    int connection = accept(listener, nullptr, nullptr);
+    if (connection == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    bool keep_serving = serve_connection(connection, connection, context);
+    close(connection);
+    if (!keep_serving)
+      break;
+  }
+  close(listener);
+  unlink(path.c_str());
   return EXIT_SUCCESS;
 }
+
+// Generates what the options ask for, once they have been checked.
+static int run(const char *program_name) {
+  if (serve)
+    return run_server(program_name);
+
+  if (!std::string(reduce_command).empty())
+    return run_reduce(program_name);
+
+  if (!std::string(seed_range).empty())
+    return run_batch(program_name);
+
+  if (slice >= 0 || !std::string(from_snapshot).empty() || write_snapshots ||
+      !std::string(dedup_index).empty()) {
+    std::unique_ptr<GenerationContext> context(new GenerationContext(seed));
+    context->stats = stats_for_run();
+    std::vector<int> test_order;
+    SnapshotInfo info;
+    if (!generate_model(context, test_order, info, program_name) ||
+        !write_model(*context, test_order, info, program_name))
+      return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+  }
+
+  GenerationContext context(seed);
+  context.stats = stats_for_run();
+  if (shards > 0)
+    return write_program(context, seed, program_name) ? EXIT_SUCCESS
+                                                      : EXIT_FAILURE;
+
+  OutputBuffer buffer(std::cout);
+  ProgramFiles files;
+  files.header = files.main = &buffer;
+  generate_program(context, files);
+
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, const char *argv[]) {
+  parse_options(argc, argv);
+
+  if (show_help) {
+    usage(argv[0]);
+    return EXIT_SUCCESS;
+  }
+
+  std::string error;
+  if (!check_options(error)) {
+    std::cerr << argv[0] << ": " << error << '\n';
+    return EXIT_FAILURE;
+  }
+
+  if (!std::string(static_asserts_path).empty() &&
+      !read_captured_layouts(static_asserts_path, captured_layouts, error)) {
+    std::cerr << argv[0] << ": " << error << '\n';
+    return EXIT_FAILURE;
+  }
+
+  bool deduplicating = !std::string(dedup_index).empty();
+  if (deduplicating && !layout_index.load(dedup_index)) {
+    std::cerr << argv[0] << ": could not read " << std::string(dedup_index)
+              << '\n';
+    return EXIT_FAILURE;
+  }
+
+  std::string coverage_file = coverage_path;
+  if (!coverage_file.empty() && !coverage.load(coverage_file)) {
+    std::cerr << argv[0] << ": could not read " << coverage_file << '\n';
+    return EXIT_FAILURE;
+  }
+  int covered_before = coverage.num_covered();
+
+  std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  int status = run(argv[0]);
+  if (deduplicating && !layout_index.save()) {
+    std::cerr << argv[0] << ": could not write " << std::string(dedup_index)
+              << '\n';
+    status = EXIT_FAILURE;
+  }
+  if (!coverage_file.empty() || coverage_bias) {
+    std::cerr << "layout coverage: " << covered_before << " -> "
+              << coverage.num_covered() << " of "
+              << coverage.num_combinations() << " feature combinations\n";
+  }
+  if (!coverage_file.empty() && !coverage.save(coverage_file)) {
+    std::cerr << argv[0] << ": could not write " << coverage_file << '\n';
+    status = EXIT_FAILURE;
+  }
+  if (stats_for_run()) {
+    std::chrono::duration<double> wall_time =
+        std::chrono::steady_clock::now() - start_time;
+    std::ofstream stats_out(stats_path);
+    run_stats.write_json(stats_out, wall_time.count());
+    if (!stats_out) {
+      std::cerr << argv[0] << ": could not write "
+                << std::string(stats_path) << '\n';
+      status = EXIT_FAILURE;
+    }
+  }
+  return status;
+}
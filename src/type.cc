@@ -1,72 +1,64 @@
 #include "type.h"
 
-std::vector<Class *> types;
+#include "layout.h"
 
-std::string Class::Field::get_field_name() const {
-  std::stringstream field_name_stream;
-  Class *record = types[class_i];
-  int num_fields = record->fields.size();
-  field_name_stream << record->get_class_name() << "FieldName" << field_i;
-  return field_name_stream.str();
+OutputBuffer &operator<<(OutputBuffer &out, ClassName name) {
+  return out << "ClassName" << name.class_i;
 }
 
-std::string Class::get_class_name() const {
-  std::stringstream class_name_stream;
-  class_name_stream << "ClassName" << class_i;
-  return class_name_stream.str();
+OutputBuffer &operator<<(OutputBuffer &out, FieldName name) {
+  return out << ClassName{name.class_i} << "FieldName" << name.field_i;
 }
 
-void Class::add_base(int base, bool is_virtual) {
-  Class *base_type = types[base];
-  indirect_vbases.insert(base_type->indirect_vbases.begin(),
-                         base_type->indirect_vbases.end());
-  indirect_nvbases.insert(base_type->indirect_nvbases.begin(),
-                          base_type->indirect_nvbases.end());
-  indirect_vbases.insert(base_type->direct_vbases.begin(),
-                         base_type->direct_vbases.end());
-  indirect_nvbases.insert(base_type->direct_nvbases.begin(),
-                          base_type->direct_nvbases.end());
+void Class::add_base(const GenerationContext &context, int base,
+                     bool is_virtual) {
+  const BaseClosure *base_type = context.base_closures[base];
+  // A direct base conflicts with later bases that inherit it the other way
+  // around, whether this class inherits it directly or through another base.
+  // The direct bases are exactly the union of the two conflict sets, and
+  // neither update below adds anything outside of it.
+  nonvirtual_conflicts.insert_all_masked(
+      base_type->vbases, nonvirtual_conflicts, virtual_conflicts);
+  virtual_conflicts.insert_all_masked(
+      base_type->nvbases, nonvirtual_conflicts, virtual_conflicts);
+  if (is_virtual || vbases.contains(base))
+    nonvirtual_conflicts.insert(base);
+  if (!is_virtual || nvbases.contains(base))
+    virtual_conflicts.insert(base);
+
+  vbases.insert_all(base_type->vbases);
+  nvbases.insert_all(base_type->nvbases);
   direct_bases.push_back(base);
   if (is_virtual) {
+    vbases.insert(base);
     direct_vbases.insert(base);
   } else {
-    direct_nvbases.insert(base);
+    nvbases.insert(base);
   }
 }
 
 bool Class::has_base(int base, bool is_virtual) const {
-  if (is_virtual) {
-    return direct_vbases.count(base) != 0 || indirect_vbases.count(base) != 0;
-  } else {
-    return direct_nvbases.count(base) != 0 || indirect_nvbases.count(base) != 0;
-  }
+  return is_virtual ? vbases.contains(base) : nvbases.contains(base);
 }
 
-bool Class::is_viable_base(int new_base) const {
-  Class *new_base_class = types[new_base];
-  for (int direct_base : direct_bases) {
-    if (direct_vbases.count(direct_base) != 0) {
-      if (new_base_class->has_base(direct_base, /*is_virtual=*/false)) {
-        return false;
-      }
-    } else {
-      if (new_base_class->has_base(direct_base, /*is_virtual=*/true)) {
-        return false;
-      }
-    }
+BaseClosure *Class::summarize(Arena &arena) const {
+  BaseClosure *summary = arena.create<BaseClosure>(arena);
+  summary->vbases.insert_all(vbases);
+  summary->nvbases.insert_all(nvbases);
+  return summary;
+}
 
-    if (indirect_nvbases.count(direct_base) != 0 &&
-        new_base_class->has_base(direct_base, /*is_virtual=*/true)) {
-      return false;
-    }
-    if (indirect_vbases.count(direct_base) != 0 &&
-        new_base_class->has_base(direct_base, /*is_virtual=*/false)) {
-      return false;
-    }
-  }
-  return true;
+bool Class::is_viable_base(const GenerationContext &context,
+                           int new_base) const {
+  const BaseClosure *new_base_class = context.base_closures[new_base];
+  return !nonvirtual_conflicts.intersects(new_base_class->nvbases) &&
+         !virtual_conflicts.intersects(new_base_class->vbases);
 }
-std::ostream &operator<<(std::ostream &stream, const Class &type) {
+
+OutputBuffer &operator<<(OutputBuffer &stream,
+                         const InContext<Class> &type_in_context) {
+  const GenerationContext &context = type_in_context.context;
+  const Class &type = type_in_context.value;
   if (type.vtordisp > -1) {
     stream << "#pragma vtordisp(" << type.vtordisp << ")\n";
   }
@@ -85,41 +77,47 @@ std::ostream &operator<<(std::ostream &stream, const Class &type) {
   if (type.has_dllexport) {
     stream << " __declspec(dllexport) ";
   }
-  stream << type.get_class_name();
-  std::string base_clause;
-  base_clause.append(": ");
+  stream << type.get_name();
+  const char *separator = ": ";
   for (int direct_base : type.direct_bases) {
-    base_clause.append("public ");
-    if (type.direct_vbases.count(direct_base) != 0) {
-      base_clause.append("virtual ");
+    stream << separator << "public ";
+    if (type.is_direct_vbase(direct_base)) {
+      stream << "virtual ";
     }
-    base_clause.append(types[direct_base]->get_class_name());
-    base_clause.append(", ");
+    stream << ClassName{direct_base};
+    separator = ", ";
   }
-  base_clause.resize(base_clause.size() - 2);
 
-  stream << base_clause << " {\n";
+  stream << " {\n";
   for (auto &method : type.methods) {
-    stream << '\t' << method << '\n';
+    stream << '\t' << in_context(context, method) << '\n';
   }
 
   for (auto &field : type.fields) {
-    stream << '\t' << *field << '\n';
+    stream << '\t' << in_context(context, field) << '\n';
   }
 
   if (type.has_ctor) {
-    stream << '\t' << type.get_class_name() << "() {\n";
+    stream << '\t' << type.get_name() << "() {\n";
     if (!type.has_dllexport) {
-      for (auto field : type.fields) {
-        if (field->is_anonymous) {
+      for (auto &field : type.fields) {
+        if (field.is_anonymous) {
           continue;
         }
-        if (field->bitfield_width > -1) {
+        if (field.bitfield_width > -1) {
           continue;
         }
-        stream << "\t\tprintf(\"" << field->get_field_name()
+        stream << "\t\tprintf(\"" << field.get_name()
                << " : %llu\\n\", (unsigned long long)((size_t)&"
-               << field->get_field_name() << " - (size_t)buffer));\n";
+               << field.get_name() << " - (size_t)buffer));\n";
+        if (context.expected_layouts) {
+          const ClassLayout &layout =
+              context.expected_layouts->get_layout(type.class_i);
+          stream << "\t\tcheck_offset(\"" << field.get_name()
+                 << "\", (size_t)&" << field.get_name()
+                 << " - (size_t)this, "
+                 << layout.field_offsets[field.field_i] / 8 << ");\n";
+        }
       }
     }
     stream << "\t}\n";
@@ -135,7 +133,9 @@ std::ostream &operator<<(std::ostream &stream, const Class &type) {
   return stream;
 }
 
-std::ostream &operator<<(std::ostream &stream, const Class::Field &field) {
+OutputBuffer &operator<<(OutputBuffer &stream,
+                         const InContext<Class::Field> &field_in_context) {
+  const Class::Field &field = field_in_context.value;
   if (field.alignment > -1) {
     if (field.gnu_alignment_spelling) {
       stream << " __attribute__ ((aligned (" << field.alignment << "))) ";
@@ -153,20 +153,20 @@ std::ostream &operator<<(std::ostream &stream, const Class::Field &field) {
     case TypeKind_Float:    stream << "float";     break;
     case TypeKind_Double:   stream << "double";    break;
     case TypeKind_PClass:
-      stream << types[field.type_class]->get_class_name() << '*';
+      stream << ClassName{field.type_class} << '*';
       break;
     case TypeKind_PMF:
-      stream << "int (" << types[field.type_class]->get_class_name() << "::*";
+      stream << "int (" << ClassName{field.type_class} << "::*";
       break;
     case TypeKind_PDM:
-      stream << "int " << types[field.type_class]->get_class_name() << "::*";
+      stream << "int " << ClassName{field.type_class} << "::*";
       break;
     case TypeKind_Class:
-      stream << types[field.type_class]->get_class_name();
+      stream << ClassName{field.type_class};
       break;
   }
   if (!field.is_anonymous) {
-    stream << ' ' << field.get_field_name();
+    stream << ' ' << field.get_name();
   }
   if (field.type == TypeKind_PMF) {
     stream << ')';
@@ -181,7 +181,9 @@ std::ostream &operator<<(std::ostream &stream, const Class::Field &field) {
   return stream;
 }
 
-std::ostream &operator<<(std::ostream &stream, const Class::Method &method) {
+OutputBuffer &operator<<(OutputBuffer &stream,
+                         const InContext<Class::Method> &method_in_context) {
+  const Class::Method &method = method_in_context.value;
   if (method.is_virtual) {
     stream << "virtual ";
   }
@@ -194,19 +196,23 @@ std::ostream &operator<<(std::ostream &stream, const Class::Method &method) {
     case TypeKind_Float:    stream << "float";     break;
     case TypeKind_Double:   stream << "double";    break;
     case TypeKind_PClass:
-      stream << types[method.ret_type_class]->get_class_name() << '*';
+      stream << ClassName{method.ret_type_class} << '*';
       break;
     case TypeKind_PMF:
-      stream << "int (" << types[method.ret_type_class]->get_class_name() << "::*";
+      stream << "int (" << ClassName{method.ret_type_class} << "::*";
       break;
     case TypeKind_PDM:
-      stream << "int " << types[method.ret_type_class]->get_class_name() << "::*";
+      stream << "int " << ClassName{method.ret_type_class} << "::*";
       break;
     case TypeKind_Class:
-      stream << types[method.ret_type_class]->get_class_name();
+      stream << ClassName{method.ret_type_class};
       break;
   }
-  stream << ' ' << method.name << '(';
+  if (method.name_class == -1) {
+    stream << " OverrideMethod(";
+  } else {
+    stream << ' ' << ClassName{method.name_class} << "Method(";
+  }
   switch (method.arg_type) {
     case TypeKind_Bool:     stream << "bool";      break;
     case TypeKind_Char:     stream << "char";      break;
@@ -216,16 +222,16 @@ std::ostream &operator<<(std::ostream &stream, const Class::Method &method) {
     case TypeKind_Float:    stream << "float";     break;
     case TypeKind_Double:   stream << "double";    break;
     case TypeKind_PClass:
-      stream << types[method.arg_type_class]->get_class_name() << '*';
+      stream << ClassName{method.arg_type_class} << '*';
       break;
     case TypeKind_PMF:
-      stream << "int (" << types[method.arg_type_class]->get_class_name() << "::*)";
+      stream << "int (" << ClassName{method.arg_type_class} << "::*)";
       break;
     case TypeKind_PDM:
-      stream << "int " << types[method.arg_type_class]->get_class_name() << "::*";
+      stream << "int " << ClassName{method.arg_type_class} << "::*";
       break;
     case TypeKind_Class:
-      stream << types[method.arg_type_class]->get_class_name();
+      stream << ClassName{method.arg_type_class};
       break;
   }
   stream << ')';
@@ -251,7 +257,7 @@ std::ostream &operator<<(std::ostream &stream, const Class::Method &method) {
       stream << '0';
       break;
     case TypeKind_Class:
-      stream << types[method.ret_type_class]->get_class_name() << "()";
+      stream << ClassName{method.ret_type_class} << "()";
       break;
   }
   stream << "; };";
@@ -0,0 +1,126 @@
+// Checks that --fast-base-selection picks bases with the same distribution as
+// the default selection.  Both generate the same seeds, and the classes of
+// each are compared by how many direct bases they have and by how many of
+// those are virtual.  The seeds are fixed, so the result is too; the
+// tolerances leave room for the sampling noise of this many classes.
+//
+// usage: base_selection_test <superfuzz> <work directory>
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "context.h"
+#include "process.h"
+#include "snapshot.h"
+#include "type.h"
+
+static const int kNumSeeds = 100;
+static const int kNumClasses = 200;
+static const int kChanceOfBase = 3;
+// Classes with more bases than this are counted together.
+static const int kMaxBucket = 12;
+
+// Largest allowed total variation distance between the two histograms of
+// direct bases per class: half the sum of the differences of their bucket
+// frequencies.
+static const double kMaxHistogramDistance = 0.02;
+// Largest allowed differences of the mean number of direct bases per class
+// and of the fraction of direct bases that are virtual.
+static const double kMaxMeanDifference = 0.05;
+static const double kMaxVirtualRatioDifference = 0.01;
+
+struct BaseStats {
+  std::vector<double> histogram;
+  double mean_bases;
+  double virtual_ratio;
+};
+
+// Generates the seeds into `dir` with `arguments` and measures their bases.
+static bool measure(const std::string &generator, const std::string &dir,
+                    const std::string &arguments, BaseStats &stats) {
+  if (!make_directory(dir))
+    return false;
+  std::string command = shell_quote(generator) + " --seed-range=1:" +
+                        std::to_string(kNumSeeds) + " --num-classes=" +
+                        std::to_string(kNumClasses) + " --chance-of-base=" +
+                        std::to_string(kChanceOfBase) +
+                        " --snapshot --out-dir=" + shell_quote(dir) + ' ' +
+                        arguments;
+  if (run_command(command) != 0) {
+    std::cerr << command << " failed\n";
+    return false;
+  }
+
+  std::vector<long> counts(kMaxBucket + 1);
+  long num_classes = 0, num_bases = 0, num_vbases = 0;
+  for (int seed = 1; seed <= kNumSeeds; ++seed) {
+    GenerationContext context(0);
+    std::vector<int> test_order;
+    SnapshotInfo info;
+    std::string error;
+    if (!read_snapshot(dir + '/' + std::to_string(seed) + ".snap", context,
+                       test_order, info, error)) {
+      std::cerr << error << '\n';
+      return false;
+    }
+    for (const Class *type : context.types) {
+      int num_direct = type->direct_bases.size();
+      ++counts[std::min(num_direct, kMaxBucket)];
+      ++num_classes;
+      num_bases += num_direct;
+      for (int base : type->direct_bases)
+        num_vbases += type->is_direct_vbase(base);
+    }
+  }
+  stats.histogram.clear();
+  for (long count : counts)
+    stats.histogram.push_back(double(count) / num_classes);
+  stats.mean_bases = double(num_bases) / num_classes;
+  stats.virtual_ratio = num_bases ? double(num_vbases) / num_bases : 0;
+  return true;
+}
+
+static void compare(const std::string &generator, const std::string &work_dir,
+                    const std::string &name, const std::string &arguments) {
+  BaseStats fast, slow;
+  if (!measure(generator, work_dir + '/' + name + "-default", arguments,
+               slow) ||
+      !measure(generator, work_dir + '/' + name + "-fast",
+               arguments + " --fast-base-selection", fast)) {
+    ++num_failures;
+    return;
+  }
+  double distance = 0;
+  for (int bucket = 0; bucket <= kMaxBucket; ++bucket)
+    distance += std::fabs(fast.histogram[bucket] - slow.histogram[bucket]);
+  distance /= 2;
+  std::cout << name << std::fixed << std::setprecision(4)
+            << ": mean bases " << slow.mean_bases << " vs " << fast.mean_bases
+            << ", virtual ratio " << slow.virtual_ratio << " vs "
+            << fast.virtual_ratio << ", histogram distance " << distance
+            << '\n';
+  CHECK(distance <= kMaxHistogramDistance);
+  CHECK(std::fabs(fast.mean_bases - slow.mean_bases) <= kMaxMeanDifference);
+  CHECK(std::fabs(fast.virtual_ratio - slow.virtual_ratio) <=
+        kMaxVirtualRatioDifference);
+}
+
+int main(int argc, const char *argv[]) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <superfuzz> <work directory>\n";
+    return EXIT_FAILURE;
+  }
+  std::string work_dir = argv[2];
+  if (!make_directory(work_dir)) {
+    std::cerr << argv[0] << ": could not create " << work_dir << '\n';
+    return EXIT_FAILURE;
+  }
+  // Which bases are viable differs between the dialects.
+  compare(argv[1], work_dir, "gnu", "--gnu-dialect");
+  compare(argv[1], work_dir, "ms", "");
+  return num_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,18 @@
+#ifndef SUPERFUZZ_TEST_CHECK_H
+#define SUPERFUZZ_TEST_CHECK_H
+
+#include <iostream>
+
+// How many checks have failed; a test exits with failure if any did.
+static int num_failures = 0;
+
+#define CHECK(condition)                                                   \
+  do {                                                                     \
+    if (!(condition)) {                                                    \
+      std::cerr << __FILE__ << ':' << __LINE__                             \
+                << ": check failed: " #condition "\n";                     \
+      ++num_failures;                                                      \
+    }                                                                      \
+  } while (0)
+
+#endif
@@ -0,0 +1,90 @@
+// Checks that classes whose layouts differ get different layout hashes, and
+// that classes laid out alike, up to renaming, get the same one.  The
+// classes differ only in whether a method overrides a virtual method of a
+// virtual base, which under the Microsoft ABI decides whether the base gets
+// a vtordisp.
+
+#include <cstdlib>
+
+#include "check.h"
+#include "context.h"
+#include "dedup.h"
+#include "layout.h"
+#include "type.h"
+
+static Class &add_class(GenerationContext &context) {
+  Class *type =
+      context.arena.create<Class>(context.types.size(), context.arena);
+  type->set_ctor(true);
+  append_class(context, type);
+  return *type;
+}
+
+// Adds the override method, which every class may declare, taking a
+// parameter of kind `arg_type`.
+static void add_override_method(Class &type, bool is_virtual,
+                                TypeKind arg_type, int arg_type_class) {
+  Class::Method method;
+  method.is_virtual = is_virtual;
+  method.arg_type = arg_type;
+  method.arg_type_class = arg_type_class;
+  type.add_method(method);
+}
+
+static bool same_layout(const ClassLayout &lhs, const ClassLayout &rhs) {
+  if (lhs.size != rhs.size || lhs.alignment != rhs.alignment ||
+      lhs.vbases.size() != rhs.vbases.size())
+    return false;
+  for (size_t vbase_i = 0; vbase_i < lhs.vbases.size(); ++vbase_i) {
+    if (lhs.vbases[vbase_i].offset != rhs.vbases[vbase_i].offset ||
+        lhs.vbases[vbase_i].has_vtordisp != rhs.vbases[vbase_i].has_vtordisp)
+      return false;
+  }
+  return true;
+}
+
+int main() {
+  GenerationContext context(0);
+  // The class the member pointer parameters point into.
+  int pointee = add_class(context).class_i;
+
+  // Declares virtual OverrideMethod(int ClassName0::*).
+  Class &base = add_class(context);
+  add_override_method(base, true, TypeKind_PDM, pointee);
+
+  // OverrideMethod(bool) hides the base's method rather than overriding it.
+  Class &hides = add_class(context);
+  hides.add_base(context, base.class_i, true);
+  add_override_method(hides, false, TypeKind_Bool, -1);
+
+  // OverrideMethod(int ClassName0::*) overrides it.
+  Class &overrides = add_class(context);
+  overrides.add_base(context, base.class_i, true);
+  add_override_method(overrides, false, TypeKind_PDM, pointee);
+
+  // The same parameter type spelled as a PMF, which overrides it too.
+  Class &overrides_pmf = add_class(context);
+  overrides_pmf.add_base(context, base.class_i, true);
+  add_override_method(overrides_pmf, false, TypeKind_PMF, pointee);
+
+  // A copy of `overrides` under another name.
+  Class &overrides_copy = add_class(context);
+  overrides_copy.add_base(context, base.class_i, true);
+  add_override_method(overrides_copy, false, TypeKind_PDM, pointee);
+
+  LayoutEngine layouts(context, LayoutABI_Microsoft);
+  // The test is only meaningful if overriding changes the layout.
+  CHECK(layouts.get_facts(overrides.class_i).method_overrides[0]);
+  CHECK(!layouts.get_facts(hides.class_i).method_overrides[0]);
+  CHECK(!same_layout(layouts.get_layout(hides.class_i),
+                     layouts.get_layout(overrides.class_i)));
+  CHECK(same_layout(layouts.get_layout(overrides.class_i),
+                    layouts.get_layout(overrides_pmf.class_i)));
+
+  update_layout_hashes(context);
+  const std::vector<uint64_t> &hashes = context.layout_hashes;
+  CHECK(hashes[hides.class_i] != hashes[overrides.class_i]);
+  CHECK(hashes[overrides.class_i] == hashes[overrides_pmf.class_i]);
+  CHECK(hashes[overrides.class_i] == hashes[overrides_copy.class_i]);
+  return num_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,14 @@
+# Runs GENERATOR with the space-separated ARGS, writing to OUTPUT, and fails
+# unless the output is byte for byte the contents of GOLDEN.
+string(REPLACE " " ";" args "${ARGS}")
+execute_process(COMMAND ${GENERATOR} ${args}
+                OUTPUT_FILE ${OUTPUT}
+                RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "${GENERATOR} ${ARGS} failed: ${status}")
+endif()
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT} ${GOLDEN}
+                RESULT_VARIABLE different)
+if(different)
+  message(FATAL_ERROR "${OUTPUT} differs from ${GOLDEN}")
+endif()
@@ -0,0 +1,26 @@
+# Runs GENERATOR with the space-separated ARGS, writing to OUTPUT, compiles
+# the program with COMPILER and runs it, and fails if it reports a MISMATCH
+# between the expected layout and the one the compiler chose.
+string(REPLACE " " ";" args "${ARGS}")
+execute_process(COMMAND ${GENERATOR} ${args}
+                OUTPUT_FILE ${OUTPUT}.cc
+                RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "${GENERATOR} ${ARGS} failed: ${status}")
+endif()
+execute_process(COMMAND ${COMPILER} -w -o ${OUTPUT} ${OUTPUT}.cc
+                RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "${COMPILER} failed on ${OUTPUT}.cc: ${status}")
+endif()
+execute_process(COMMAND ${OUTPUT}
+                OUTPUT_VARIABLE output
+                RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "${OUTPUT} failed: ${status}")
+endif()
+string(REGEX MATCHALL "MISMATCH[^\n]*" mismatches "${output}")
+if(mismatches)
+  string(REPLACE ";" "\n" mismatches "${mismatches}")
+  message(FATAL_ERROR "${OUTPUT}.cc:\n${mismatches}")
+endif()